@@ -1,5 +1,7 @@
 #include <set>
 #include <map>
+#include <string>
+#include <stdexcept>
 
 #include "Matrix.hpp"
 
@@ -23,119 +25,752 @@ void printVar(ostream &flux, int x) {
   }
 }
 
-Matrix::Matrix(vector<vector<pair<GFElement, int>>> const & sys) {
-  set<int> variables;
-  for (auto const & v : sys) {
-    for (auto const & p : v) variables.emplace(p.second);
+template <unsigned int Poly, unsigned int Dim>
+MatrixT<Poly, Dim>::MatrixT(Equations const & sys, vector<int> const & pivots) {
+  vector<int> v;
+  for (auto const & eq : sys) {
+    for (auto const & p : eq) v.emplace_back(p.second);
   }
+  sort(v.begin(), v.end());
+  v.erase(unique(v.begin(), v.end()), v.end());
+  maxvar = 0;
+  for (auto x : v) maxvar = max(maxvar, abs(x));
+  vector<unsigned> index (2*maxvar+1);
+  for (unsigned j = 0; j < v.size(); ++j) index[v[j] + maxvar] = j;
+
+  // dense system in one array, row i is mat[i*m .. (i+1)*m)
   unsigned n = sys.size();
-  unsigned m = 0;
-  map<int, unsigned> mapvars;
-  for (auto x : variables) {
-    mapvars[x] = m++;
-  }
-  vector<int> v (variables.begin(), variables.end());
-  vector<vector<GFElement>> mat (n, vector<GFElement> (m, 0));
+  unsigned const m = v.size();
+  vector<GFElement> mat (size_t(n)*m, 0);
+  auto const row = [&mat, m](unsigned i) {return mat.data() + size_t(i)*m;};
   for (unsigned i = 0; i < n; ++i) {
-    for (auto const & p : sys[i]) mat[i][mapvars[p.second]] = p.first;
+    for (auto const & p : sys[i]) row(i)[index[p.second + maxvar]] = p.first;
+  }
+
+  // rank 0 for the variables of pivots, eliminated first
+  vector<uint8_t> rank (m, 1);
+  for (auto x : pivots) {
+    if (x >= -maxvar && x <= maxvar && binary_search(v.begin(), v.end(), x)) rank[index[x + maxvar]] = 0;
+  }
+  n = eliminate(mat, n, v, rank, 0);
+  assign(mat, n, v);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::appendLines(Equations const & sys, vector<int> const & pivots) {
+  // the variables are the fronts, the columns (v[positionOf(x)] == x) and then the new variables of sys
+  unsigned const n0 = nblines;
+  vector<int> v (front, front + nblines);
+  v.insert(v.end(), columns, columns + nbcols);
+  auto const known = [this](int x) {return !block.empty() && positionOf(x) != nopos;};
+  vector<int> added;
+  for (auto const & eq : sys) {
+    for (auto const & p : eq) {
+      if (!known(p.second)) added.emplace_back(p.second);
+    }
+  }
+  sort(added.begin(), added.end());
+  added.erase(unique(added.begin(), added.end()), added.end());
+  v.insert(v.end(), added.begin(), added.end());
+  auto const index = [&](int x) -> unsigned {
+    return known(x) ? positionOf(x) : n0 + nbcols + (lower_bound(added.begin(), added.end(), x) - added.begin());
+  };
+
+  // dense system: the lines as they are, then the equations of sys reduced on their fronts
+  unsigned n = n0 + sys.size();
+  unsigned const m = v.size();
+  vector<GFElement> mat (size_t(n)*m, 0);
+  auto const row = [&mat, m](unsigned i) {return mat.data() + size_t(i)*m;};
+  for (unsigned l = 0; l < n0; ++l) {
+    row(l)[l] = 1;
+    for (unsigned c : nonzeros(l)) row(l)[n0 + c] = Row::get(line(l), c);
+  }
+  for (unsigned i = 0; i < sys.size(); ++i) {
+    auto const ri = row(n0 + i);
+    for (auto const & p : sys[i]) ri[index(p.second)] += p.first;
+    for (unsigned l = 0; l < n0; ++l) {
+      if (ri[l] == 0) continue;
+      auto const coef = ri[l];
+      ri[l] = 0;
+      for (unsigned c : nonzeros(l)) ri[n0 + c] += coef*GFElement(Row::get(line(l), c));
+    }
+  }
+
+  vector<uint8_t> rank (m, 1);
+  for (auto x : pivots) {
+    if (known(x) || binary_search(added.begin(), added.end(), x)) rank[index(x)] = 0;
+  }
+  n = eliminate(mat, n, v, rank, n0);
+  trail.clear();
+  assign(mat, n, v);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+typename MatrixT<Poly, Dim>::Solutions MatrixT<Poly, Dim>::solutions(vector<int> const & zeros) const {
+  Solutions res;
+  res.vars.assign(front, front + nblines);
+  res.vars.insert(res.vars.end(), columns, columns + nbcols);
+
+  // the columns of zeros are dropped and the lines of zeros are constraints on the columns left, solved by
+  // Gauss-Jordan: the columns that are not pivots of the constraints are free, one basis vector each
+  vector<bool> zero (nbcols, false);
+  vector<vector<GFElement>> cons;
+  for (auto x : zeros) {
+    auto const c = columnOf(x);
+    if (c < nbcols) zero[c] = true;
+  }
+  for (auto x : zeros) {
+    auto const l = lineOf(x);
+    if (l == nblines) continue;
+    vector<GFElement> row (nbcols, 0);
+    for (unsigned c : nonzeros(l)) {
+      if (!zero[c]) row[c] = Row::get(line(l), c);
+    }
+    cons.emplace_back(move(row));
+  }
+  vector<unsigned> pivotOf (nbcols, nbcols); // constraint whose pivot is the column
+  unsigned rank = 0;
+  for (unsigned c = 0; c < nbcols && rank < cons.size(); ++c) {
+    if (zero[c]) continue;
+    unsigned i = rank;
+    while (i < cons.size() && cons[i][c] == 0) ++i;
+    if (i == cons.size()) continue;
+    swap(cons[i], cons[rank]);
+    auto & rp = cons[rank];
+    GFElement::row_scale(rp.data(), rp[c].getInverse(), nbcols);
+    for (unsigned k = 0; k < cons.size(); ++k) {
+      if (k != rank && cons[k][c] != 0) GFElement::row_axpy(cons[k].data(), rp.data(), cons[k][c], nbcols);
+    }
+    pivotOf[c] = rank++;
+  }
+
+  for (unsigned f = 0; f < nbcols; ++f) {
+    if (zero[f] || pivotOf[f] != nbcols) continue;
+    vector<GFElement> sol (nblines + nbcols, 0);
+    auto const col = sol.data() + nblines;
+    col[f] = 1;
+    for (unsigned c = 0; c < nbcols; ++c) {
+      if (pivotOf[c] != nbcols) col[c] = cons[pivotOf[c]][f];
+    }
+    for (unsigned l = 0; l < nblines; ++l) {
+      for (unsigned c : nonzeros(l)) sol[l] += GFElement(Row::get(line(l), c))*col[c];
+    }
+    res.basis.emplace_back(move(sol));
   }
+  return res;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+uint64_t MatrixT<Poly, Dim>::enumerate(Solutions const & space, vector<int> const & nonzeros,
+  function<bool(vector<GFElement> const &)> const & f) const {
+  unsigned const bits = 31 - __builtin_clz(Poly); // degree of the field over GF(2)
+  unsigned const total = bits*space.dimension();
+  if (total >= 64) throw invalid_argument("Matrix::enumerate: 2^" + to_string(total) + " solutions to walk");
+  unsigned const n = space.vars.size();
+  vector<bool> constrained (n, false);
+  for (auto x : nonzeros) {
+    auto const it = find(space.vars.begin(), space.vars.end(), x);
+    if (it != space.vars.end()) constrained[it - space.vars.begin()] = true;
+  }
+  vector<vector<unsigned>> supports;
+  for (auto const & b : space.basis) {
+    supports.emplace_back();
+    for (unsigned p = 0; p < n; ++p) {
+      if (b[p] != 0) supports.back().emplace_back(p);
+    }
+  }
+
+  // step x adds 2^k times the basis vector i, for the bit t = bits*i + k that changes from x-1 to x in Gray code
+  vector<GFElement> sol (n, 0);
+  unsigned zerosLeft = std::count(constrained.begin(), constrained.end(), true);
+  uint64_t found = 0;
+  auto const report = [&]() {
+    if (zerosLeft != 0) return true;
+    ++found;
+    return f(sol);
+  };
+  if (!report()) return found;
+  for (uint64_t x = 1; x < (uint64_t(1) << total); ++x) {
+    unsigned const t = __builtin_ctzll(x);
+    auto const coef = GFElement(GFSymbol(1u << (t%bits)));
+    auto const & b = space.basis[t/bits];
+    for (auto p : supports[t/bits]) {
+      bool const wasZero = (sol[p] == 0);
+      sol[p] += coef*b[p];
+      if (constrained[p] && wasZero != (sol[p] == 0)) zerosLeft += wasZero ? -1 : 1;
+    }
+    if (!report()) break;
+  }
+  return found;
+}
+
+// Sum over the subsets S of cols[from..] of (-1)^|S| q^(k - rank(basis, S)) with q = 2^bits: the vectors of a space
+// of dimension k with the coordinates S null, counted by inclusion-exclusion. basis is in echelon form (basis[b] is 1
+// on pivots[b] and null on the pivots before it), each column of S is reduced on it once on the way down
+template <typename Element>
+static __int128 exclusion(vector<vector<Element>> const & cols, unsigned from, vector<vector<Element>> & basis,
+  vector<unsigned> & pivots, unsigned bits, unsigned k) {
+  __int128 res = __int128(1) << (bits*(k - basis.size()));
+  for (unsigned j = from; j < cols.size(); ++j) {
+    auto v = cols[j];
+    for (unsigned b = 0; b < basis.size(); ++b) {
+      auto const c = v[pivots[b]];
+      if (c != 0) Element::row_axpy(v.data(), basis[b].data(), c, k);
+    }
+    unsigned p = 0;
+    while (p < k && v[p] == 0) ++p;
+    if (p == k) { // rank(basis, S + j) = rank(basis, S)
+      res -= exclusion(cols, j+1, basis, pivots, bits, k);
+      continue;
+    }
+    Element::row_scale(v.data(), v[p].getInverse(), k);
+    basis.emplace_back(move(v));
+    pivots.emplace_back(p);
+    res -= exclusion(cols, j+1, basis, pivots, bits, k);
+    basis.pop_back();
+    pivots.pop_back();
+  }
+  return res;
+}
 
-  // for (unsigned i = 0; i < n; ++i) {
-  //   for (unsigned j = 0; j < m; ++j) {
-  //     if (mat[i][j] == 0) continue;
-  //     cout << " + " << mat[i][j] << ".";
-  //     printVar(cout, v[j]);
-  //   }
-  //   cout << endl;
-  // }
-  // cout << " -------------- " << endl;
-  // getchar();
+template <unsigned int Poly, unsigned int Dim>
+uint64_t MatrixT<Poly, Dim>::count(Solutions const & space, vector<int> const & nonzeros) const {
+  unsigned const bits = 31 - __builtin_clz(Poly);
+  unsigned const n = space.vars.size();
+  unsigned const d = space.dimension();
+  auto const mulSat = [](uint64_t a, uint64_t b) {return (b != 0 && a > UINT64_MAX/b) ? UINT64_MAX : a*b;};
 
+  // the positions of nonzeros are linked by the basis vectors nonzero on both (union-find on the positions), the
+  // solutions are the products of those of the components times q for each basis vector on no such position
+  vector<unsigned> parent (n, n);
+  for (auto x : nonzeros) {
+    auto const it = find(space.vars.begin(), space.vars.end(), x);
+    if (it != space.vars.end()) parent[it - space.vars.begin()] = it - space.vars.begin();
+  }
+  auto const root = [&parent](unsigned p) {
+    while (parent[p] != p) p = parent[p] = parent[parent[p]];
+    return p;
+  };
+  vector<unsigned> rootOf (d, n);
+  for (unsigned i = 0; i < d; ++i) {
+    for (unsigned p = 0; p < n; ++p) {
+      if (parent[p] == n || space.basis[i][p] == 0) continue;
+      auto const r = root(p);
+      if (rootOf[i] != n) parent[r] = root(rootOf[i]);
+      else rootOf[i] = r;
+    }
+  }
+  map<unsigned, pair<vector<unsigned>, vector<unsigned>>> components; // root -> (positions, basis vectors)
   for (unsigned p = 0; p < n; ++p) {
-    unsigned c = p;
-    while (c < m && mat[p][c] == 0) ++c;
-    if (c == m) swap(mat[p--], mat[--n]);
-    else {
-      if (c != p) {
-        for (unsigned i = 0; i < n; ++i) swap(mat[i][p], mat[i][c]);
-        swap(v[p], v[c]);
+    if (parent[p] != n) components[root(p)].first.emplace_back(p);
+  }
+  for (unsigned i = 0; i < d; ++i) {
+    if (rootOf[i] != n) components[root(rootOf[i])].second.emplace_back(i);
+  }
+
+  uint64_t res = 1;
+  unsigned rank = 0;
+  for (auto const & comp : components) {
+    auto const & pos = comp.second.first;
+    auto const & vecs = comp.second.second;
+    if (vecs.empty()) return 0; // a position null on all the solutions
+
+    // the basis vectors on the positions, reduced to k independent rows of the same span
+    vector<vector<GFElement>> rows;
+    for (auto i : vecs) {
+      rows.emplace_back();
+      for (auto p : pos) rows.back().emplace_back(space.basis[i][p]);
+    }
+    unsigned const m = pos.size();
+    unsigned k = 0;
+    for (unsigned c = 0; c < m && k < rows.size(); ++c) {
+      unsigned r = k;
+      while (r < rows.size() && rows[r][c] == 0) ++r;
+      if (r == rows.size()) continue;
+      swap(rows[r], rows[k]);
+      GFElement::row_scale(rows[k].data(), rows[k][c].getInverse(), m);
+      for (unsigned i = k+1; i < rows.size(); ++i) {
+        if (rows[i][c] != 0) GFElement::row_axpy(rows[i].data(), rows[k].data(), rows[i][c], m);
+      }
+      ++k;
+    }
+    rows.resize(k);
+    rank += k;
+
+    // two positions with proportional columns are null together, one of them is kept
+    set<vector<GFSymbol>> seen;
+    vector<vector<GFElement>> cols;
+    for (unsigned c = 0; c < m; ++c) {
+      vector<GFElement> col;
+      for (auto const & row : rows) col.emplace_back(row[c]);
+      auto const inv = (*find_if(col.begin(), col.end(), [](GFElement const & e) {return e != 0;})).getInverse();
+      vector<GFSymbol> key;
+      for (auto & e : col) key.emplace_back((e = e*inv).getValue());
+      if (seen.emplace(move(key)).second) cols.emplace_back(move(col));
+    }
+
+    // walk the span (2^(bits*k) steps) or sum over the subsets of the columns (2^|cols|), the smaller
+    uint64_t found;
+    if (bits*k <= cols.size()) {
+      if (bits*k > 40) throw invalid_argument("Matrix::count: component of 2^" + to_string(bits*k) + " solutions");
+      Solutions sub;
+      for (unsigned c = 0; c < cols.size(); ++c) sub.vars.emplace_back(c);
+      for (unsigned i = 0; i < k; ++i) {
+        sub.basis.emplace_back();
+        for (auto const & col : cols) sub.basis.back().emplace_back(col[i]);
       }
-      auto const coefInv = mat[p][p].getInverse();
-      for (c = p; c < m; ++c) mat[p][c] *= coefInv;
-      for (unsigned l = 0; l < n; ++l) {
-        if (mat[l][p] == 0 || l == p) continue;
-        auto const coef = mat[l][p];
-        for (c = p; c < m; ++c) mat[l][c] -= coef*mat[p][c];
+      found = enumerate(sub, sub.vars, [](vector<GFElement> const &) {return true;});
+    }
+    else if (bits*k > 120) {
+      // at least q^(k-1)(q - |cols|) solutions (union bound), beyond 64 bits when |cols| < q
+      if (cols.size() >= (1u << bits)) throw invalid_argument("Matrix::count: component too large");
+      found = UINT64_MAX;
+    }
+    else {
+      if (cols.size() > 40) throw invalid_argument("Matrix::count: component of " + to_string(cols.size()) + " positions");
+      vector<vector<GFElement>> basis;
+      vector<unsigned> pivots;
+      auto const sum = exclusion(cols, 0, basis, pivots, bits, k);
+      found = (sum > UINT64_MAX) ? UINT64_MAX : uint64_t(sum);
+    }
+    if (found == 0) return 0;
+    res = mulSat(res, found);
+  }
+  for (unsigned i = rank; i < d; ++i) res = mulSat(res, uint64_t(1) << bits);
+  return res;
+}
+
+// Eliminates the lines first.. of the dense system mat (n lines on the variables of v) on the columns first.., the
+// lines and columns before first being already reduced: the fronts are chosen in Markowitz order of rank and swapped
+// to the columns first.. (with v and rank), the lines left null are dropped and the number of fronts is returned
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::eliminate(vector<GFElement> & mat, unsigned n, vector<int> & v, vector<uint8_t> & rank, unsigned first) {
+  unsigned const m = v.size();
+  auto const row = [&mat, m](unsigned i) {return mat.data() + size_t(i)*m;};
+
+  // Markowitz counts of the remaining system (lines p.., columns p..), updated by the reductions, and the lines of
+  // the nonzero coefficients of each column (bit l%64 of colrows[j*words + l/64]) so that a column is scanned
+  // on its nonzeros only
+  unsigned const words = (n + 63)/64;
+  vector<unsigned> rowcount (n, 0), colcount (m, 0);
+  vector<uint64_t> colrows (size_t(m)*words, 0);
+  auto const flip = [&colrows, words](unsigned l, unsigned j) {colrows[size_t(j)*words + l/64] ^= uint64_t(1) << (l%64);};
+  auto const forEachLine = [&colrows, words](unsigned j, unsigned from, unsigned to, auto && f) {
+    auto const bits = colrows.data() + size_t(j)*words;
+    for (unsigned w = from/64; w < words; ++w) {
+      auto b = bits[w];
+      if (w == from/64) b &= ~uint64_t(0) << (from%64);
+      for (; b != 0; b &= b - 1) {
+        unsigned const l = 64*w + __builtin_ctzll(b);
+        if (l >= to) return;
+        f(l);
       }
     }
+  };
+  for (unsigned i = 0; i < n; ++i) {
+    for (unsigned j = 0; j < m; ++j) {
+      if (row(i)[j] == 0) continue;
+      flip(i, j);
+      if (i < first || j < first) continue;
+      rowcount[i] += 1;
+      colcount[j] += 1;
+    }
   }
 
-  // for (unsigned i = 0; i < n; ++i) {
-  //   for (unsigned j = 0; j < m; ++j) {
-  //     if (mat[i][j] == 0) continue;
-  //     cout << " + " << mat[i][j] << ".";
-  //     printVar(cout, v[j]);
-  //   }
-  //   cout << endl;
-  // }
-  // cout << " -------------- " << endl;
+  vector<unsigned> candidates, suppivot, reduced;
+  for (unsigned p = first; p < n; ++p) {
+    // the pivot is the coefficient of lowest (rowcount - 1)*(colcount - 1), which bounds the coefficients its
+    // reductions may fill, on the columns of lowest rank: the columns are tried by increasing count until the bound
+    // of the next one with the lightest line cannot be lower
+    candidates.clear();
+    for (unsigned j = p; j < m; ++j) {
+      if (colcount[j] == 0) continue;
+      if (!candidates.empty() && rank[j] < rank[candidates[0]]) candidates.clear();
+      if (candidates.empty() || rank[j] == rank[candidates[0]]) candidates.emplace_back(j);
+    }
+    if (candidates.empty()) { // the lines left are null
+      n = p;
+      break;
+    }
+    stable_sort(candidates.begin(), candidates.end(), [&colcount](unsigned j1, unsigned j2) {return colcount[j1] < colcount[j2];});
+    unsigned lightest = m;
+    for (unsigned l = p; l < n; ++l) {
+      if (rowcount[l] != 0) lightest = min(lightest, rowcount[l]);
+    }
+    unsigned i = n, c = m;
+    size_t best = 0;
+    for (auto j : candidates) {
+      if (c != m && size_t(colcount[j] - 1)*(lightest - 1) > best) break;
+      forEachLine(j, p, n, [&](unsigned l) {
+        auto const cost = size_t(colcount[j] - 1)*(rowcount[l] - 1);
+        if (c == m || cost < best || (cost == best && (l < i || (l == i && j < c)))) {
+          i = l;
+          c = j;
+          best = cost;
+        }
+      });
+    }
+    auto const rp = row(p);
+    if (i != p) {
+      auto const ri = row(i);
+      for (unsigned j = p; j < m; ++j) {
+        if ((rp[j] == 0) == (ri[j] == 0)) continue;
+        flip(p, j);
+        flip(i, j);
+      }
+      swap_ranges(rp, rp + m, ri);
+      swap(rowcount[p], rowcount[i]);
+    }
+    if (c != p) {
+      for (unsigned l = 0; l < n; ++l) swap(row(l)[p], row(l)[c]);
+      swap_ranges(colrows.begin() + size_t(p)*words, colrows.begin() + size_t(p+1)*words, colrows.begin() + size_t(c)*words);
+      swap(v[p], v[c]);
+      swap(rank[p], rank[c]);
+      swap(colcount[p], colcount[c]);
+    }
+    auto const coefInv = rp[p].getInverse();
+    GFElement::row_scale(rp + p, coefInv, m-p);
+
+    // The equations only link neighbouring rounds, so the pivot lines stay short: the reductions only go through
+    // the support of the pivot line, and update the counts of the lines l > p (the line p leaves the remaining system)
+    suppivot.clear();
+    for (unsigned j = p; j < m; ++j) {
+      if (rp[j] == 0) continue;
+      suppivot.emplace_back(j);
+      colcount[j] -= 1;
+    }
+    reduced.clear();
+    forEachLine(p, 0, n, [&](unsigned l) {if (l != p) reduced.emplace_back(l);});
+    for (auto l : reduced) {
+      auto const rl = row(l);
+      auto const coef = rl[p];
+      for (auto j : suppivot) {
+        bool const wasZero = (rl[j] == 0);
+        rl[j] += coef*rp[j];
+        if (wasZero == (rl[j] == 0)) continue;
+        flip(l, j);
+        if (l < p) continue;
+        int const d = wasZero ? 1 : -1;
+        rowcount[l] += d;
+        colcount[j] += d;
+      }
+    }
+  }
+  return n;
+}
 
-  front = vector<int> (n);
+// Lays out the reduced dense system mat: line i has the front v[i] (coefficient 1, i < n) and its coefficients on
+// the columns v[n..]
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::assign(vector<GFElement> const & mat, unsigned n, vector<int> const & v) {
+  unsigned const m = v.size();
+  auto const row = [&mat, m](unsigned i) {return mat.data() + size_t(i)*m;};
+  maxvar = 0;
+  for (auto x : v) maxvar = max(maxvar, abs(x));
+  nbcols = m-n;
+  nblines = n;
+  nzcap = nbcols;
+  stride = Row::nbWords(nzcap);
+  block.assign(offsets().back(), 0);
+  rebase();
   for (unsigned i = 0; i < n; ++i) front[i] = v[i];
-  columns = vector<int> (m-n);
   for (unsigned i = n; i < m; ++i) columns[i-n] = v[i];
-  space = vector<GFElement> (n*(m-n));
+  fill(position, position + 2*maxvar+1, nopos);
+  for (unsigned i = 0; i < m; ++i) position[v[i] + maxvar] = i;
+  resetVariables();
   for (unsigned i = 0; i < n; ++i) {
-    for (unsigned j = n; j < m; ++j) space[i*(m-n) + j-n] = mat[i][j];
+    slot[i] = i;
+    for (unsigned j = n; j < m; ++j) Row::set(line(i), j-n, row(i)[j].getValue());
+    resetSupport(i);
   }
-  nbcols = m-n;
-  nblines = n;
-  lines = vector<GFElement *> (n);
-  for (unsigned i = 0; i < n; ++i) lines[i] = space.data() + i*nbcols;
 }
 
-Matrix Matrix::extract(unsigned l) const {
-  vector<vector<pair<GFElement, int>>> sys;
-  for (; l < nblines; ++l) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, front[l]);
-    for (unsigned i = 0; i < nbcols; ++i) {
-      if ((*this)(l,i) != 0) v.emplace_back((*this)(l,i), columns[i]);
+// offsets (in words) of space, supspace, front, columns, position, slot, lineepoch, rowmasks, colmasks and kindmasks,
+// values, kinds and cells, and rounds in the block, followed by its size
+template <unsigned int Poly, unsigned int Dim>
+array<size_t, 12> MatrixT<Poly, Dim>::offsets() const {
+  size_t const bytes[11] = {nblines*stride*sizeof(typename Row::Word), nblines*(nzcap+1)*sizeof(uint16_t), nblines*sizeof(int),
+    nzcap*sizeof(int), (2*maxvar+1)*sizeof(uint16_t), nblines*sizeof(uint16_t), nblines*sizeof(unsigned),
+    nblines*maskWords()*sizeof(uint64_t), 7*maskWords()*sizeof(uint64_t), 3*(maxvar+1)*sizeof(uint8_t),
+    (maxvar+1)*sizeof(uint16_t)};
+  array<size_t, 12> off;
+  off[0] = 0;
+  for (unsigned i = 0; i < 11; ++i) off[i+1] = off[i] + (bytes[i] + sizeof(uint64_t) - 1)/sizeof(uint64_t);
+  return off;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::rebase() {
+  if (block.empty()) return;
+  auto const off = offsets();
+  auto const p = block.data();
+  space = reinterpret_cast<typename Row::Word *>(p + off[0]);
+  supspace = reinterpret_cast<uint16_t *>(p + off[1]);
+  front = reinterpret_cast<int *>(p + off[2]);
+  columns = reinterpret_cast<int *>(p + off[3]);
+  position = reinterpret_cast<uint16_t *>(p + off[4]);
+  slot = reinterpret_cast<uint16_t *>(p + off[5]);
+  lineepoch = reinterpret_cast<unsigned *>(p + off[6]);
+  rowmasks = p + off[7];
+  colmasks = p + off[8];
+  kindmasks = colmasks + 3*maskWords();
+  values = reinterpret_cast<uint8_t *>(p + off[9]);
+  kinds = values + maxvar+1;
+  cells = kinds + maxvar+1;
+  rounds = reinterpret_cast<uint16_t *>(p + off[10]);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+typename MatrixT<Poly, Dim>::Arena & MatrixT<Poly, Dim>::arena() {
+  static thread_local Arena a;
+  return a;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::clone(MatrixT const & m) {
+  auto & a = arena();
+  if (block.capacity() < m.block.size()) {
+    auto it = find_if(a.blocks.begin(), a.blocks.end(), [&m](vector<uint64_t> const & b) {return b.capacity() >= m.block.size();});
+    if (it != a.blocks.end()) {
+      block.swap(*it);
+      if (it->capacity() == 0) a.blocks.erase(it);
+    }
+  }
+  if (trail.undo.capacity() == 0 && !a.trails.empty()) {
+    trail = move(a.trails.back());
+    a.trails.pop_back();
+  }
+  block.assign(m.block.begin(), m.block.end());
+  rebase();
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::release() {
+  static constexpr size_t maxfree = 16;
+  auto & a = arena();
+  if (block.capacity() != 0 && a.blocks.size() < maxfree) a.blocks.emplace_back(move(block));
+  if (trail.undo.capacity() != 0 && a.trails.size() < maxfree) {
+    trail.clear();
+    a.trails.emplace_back(move(trail));
+  }
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::swapStorage(MatrixT & m) {
+  std::swap(nbcols, m.nbcols);
+  std::swap(nblines, m.nblines);
+  std::swap(maxvar, m.maxvar);
+  std::swap(nzcap, m.nzcap);
+  std::swap(stride, m.stride);
+  std::swap(lastepoch, m.lastepoch);
+  block.swap(m.block);
+  std::swap(trail, m.trail);
+  rebase();
+  m.rebase();
+}
+
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::weight() const {
+  unsigned w = 0;
+  for (unsigned l = 0; l < nblines; ++l) w += nonzeros(l).size();
+  return w;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::sparsify(unsigned start) {
+  unsigned removed = 0;
+  vector<uint16_t> cols;
+  for (bool improved = true; improved; ) {
+    improved = false;
+    for (unsigned l = start; l < nblines; ++l) {
+      auto const sup = nonzeros(l);
+      cols.assign(sup.begin(), sup.end());
+      for (unsigned c : cols) {
+        // the exchange only changes the lines i with a nonzero coefficient b on c, l keeps its weight: i becomes
+        // i - (b/a) l (a the coefficient of l on c) on the other columns and -b/a on c, so its weight is the size of
+        // the union of the supports of i and l less the columns where i - (b/a) l cancels
+        auto const ml = rowMask(l);
+        auto const pivot = line(l);
+        GFElement const a = Row::get(pivot, c);
+        int gain = 0;
+        for (unsigned i = 0; i < nblines; ++i) {
+          GFElement const b = Row::get(line(i), c);
+          if (i == l || b == 0) continue;
+          auto const mi = rowMask(i);
+          auto const f = b/a;
+          for (unsigned w = 0; w < maskWords(); ++w) {
+            gain += __builtin_popcountll(mi[w]) - __builtin_popcountll(mi[w] | ml[w]);
+            for (auto both = mi[w] & ml[w]; both != 0; both &= both - 1) {
+              unsigned const j = 64*w + __builtin_ctzll(both);
+              if (j != c && GFElement(Row::get(line(i), j)) == f*GFElement(Row::get(pivot, j))) gain += 1;
+            }
+          }
+        }
+        if (gain > 0) {
+          swapLineColumn(l, c);
+          removed += gain;
+          improved = true;
+          break;
+        }
+      }
+    }
+  }
+  return removed;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::resetSupport(unsigned i) const {
+  auto const s = support(i);
+  auto const mask = rowmasks + slot[i]*maskWords();
+  fill(mask, mask + maskWords(), 0);
+  s[0] = Row::support(line(i), nbcols, s + 1, nzcap, mask);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+bool MatrixT<Poly, Dim>::isZeroOn(unsigned i, vector<uint64_t> const & mask) const {
+  auto const row = rowMask(i);
+  for (unsigned w = 0; w < maskWords() && w < mask.size(); ++w) {
+    if (row[w] & mask[w]) return false;
+  }
+  return true;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::resetMask(unsigned s) const {
+  auto const sup = supspace + s*(nzcap+1);
+  auto const mask = rowmasks + s*maskWords();
+  fill(mask, mask + maskWords(), 0);
+  for (unsigned k = 1; k <= sup[0]; ++k) mask[sup[k]/64] |= uint64_t(1) << (sup[k]%64);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::resetVariables() {
+  for (int u = 0; u <= maxvar; ++u) {
+    values[u] = 2;
+    kinds[u] = (u/16)%4;
+    rounds[u] = (u/16)/4;
+    cells[u] = u%16;
+  }
+  for (unsigned c = 0; c < nbcols; ++c) resetColumn(c);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::resetColumn(unsigned c) {
+  auto const bit = uint64_t(1) << (c%64);
+  for (unsigned v = 0; v < 7; ++v) colmasks[v*maskWords() + c/64] &= ~bit; // values then kinds
+  if (c >= nbcols) return;
+  auto const u = abs(columns[c]);
+  colmasks[values[u]*maskWords() + c/64] |= bit;
+  kindmasks[kinds[u]*maskWords() + c/64] |= bit;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::setValue(uint8_t & cell, int x, uint8_t v) {
+  if (!trail.epochs.empty()) trail.undo.push_back(Undo {Undo::Value, cell, 0, 0, 0, x, &cell});
+  cell = v;
+  if (abs(x) > maxvar) return;
+  values[abs(x)] = v;
+  auto const c1 = columnOf(x), c2 = columnOf(-x);
+  if (c1 != nbcols) resetColumn(c1);
+  if (c2 != nbcols) resetColumn(c2);
+}
+
+// The lines l.. are already reduced on their fronts: they are copied as they are, restricted to the columns they use
+template <unsigned int Poly, unsigned int Dim>
+MatrixT<Poly, Dim> MatrixT<Poly, Dim>::extract(unsigned l) const {
+  vector<unsigned> newcol (nbcols, nbcols);
+  for (unsigned i = l; i < nblines; ++i) {
+    for (unsigned c : nonzeros(i)) newcol[c] = 0;
+  }
+  MatrixT res;
+  res.nblines = nblines - l;
+  res.nbcols = 0;
+  for (unsigned c = 0; c < nbcols; ++c) {
+    if (newcol[c] == 0) {
+      newcol[c] = res.nbcols++;
+      res.maxvar = max(res.maxvar, abs(columns[c]));
     }
-    sys.emplace_back(move(v));
   }
-  return Matrix(sys);
+  for (unsigned i = l; i < nblines; ++i) res.maxvar = max(res.maxvar, abs(front[i]));
+  res.nzcap = res.nbcols;
+  res.stride = Row::nbWords(res.nzcap);
+  res.block.assign(res.offsets().back(), 0);
+  res.rebase();
+  fill(res.position, res.position + 2*res.maxvar+1, nopos);
+  for (unsigned c = 0; c < nbcols; ++c) {
+    if (newcol[c] == nbcols) continue;
+    res.columns[newcol[c]] = columns[c];
+    res.position[columns[c] + res.maxvar] = res.nblines + newcol[c];
+  }
+  res.resetVariables();
+  for (unsigned i = 0; i < res.nblines; ++i) {
+    res.front[i] = front[l+i];
+    res.position[front[l+i] + res.maxvar] = i;
+    res.slot[i] = i;
+    auto const src = line(l+i);
+    auto const dst = res.line(i);
+    for (unsigned c : nonzeros(l+i)) Row::set(dst, newcol[c], Row::get(src, c));
+    res.resetSupport(i);
+  }
+  return res;
 }
 
-void Matrix::swapLineColumn(unsigned l, unsigned c) {
-  auto coef = (*this)(l,c).getInverse();
-  for (unsigned i = 0; i < nbcols; ++i) (*this)(l,i) *= coef;
-  (*this)(l,c) = 0;
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::swapLineColumn(unsigned l, unsigned c) {
+  bool const logged = !trail.epochs.empty();
+  if (logged) saveLine(l);
+  // the rows are read and written through local pointers: the stores of a byte row may alias the members
+  auto const pivot = line(l);
+  auto const coef = GFElement(Row::get(pivot, c)).getInverse();
+  Row::scale(pivot, coef.getValue(), nbcols);
+  Row::set(pivot, c, 0);
   for (unsigned i = 0; i < nblines; ++i) {
-    if ((*this)(i,c) == 0) continue;
-    auto coef2 = (*this)(i,c);
-    for (unsigned j = 0; j < nbcols; ++j) (*this)(i,j) += coef2*(*this)(l,j);
-    (*this)(i,c) = coef*coef2;
+    auto const row = line(i);
+    GFElement const coef2 = Row::get(row, c);
+    if (coef2 == 0) continue;
+    if (logged) saveLine(i);
+    Row::axpy(row, pivot, coef2.getValue(), nbcols);
+    Row::set(row, c, (coef*coef2).getValue());
+    support(i)[0] = nzstale;
   }
-  (*this)(l,c) = coef;
+  Row::set(pivot, c, coef.getValue()); // same nonzero coefficients as before the scaling, the support of l is still valid
   swap(front[l], columns[c]);
+  position[front[l] + maxvar] = l;
+  position[columns[c] + maxvar] = nblines + c;
+  resetColumn(c);
+  if (!trail.epochs.empty()) trail.undo.push_back(Undo {Undo::SwapLineColumn, 0, uint16_t(l), uint16_t(c), 0, 0, nullptr});
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::saveLine(unsigned l) {
+  auto const s = slot[l];
+  if (lineepoch[s] == trail.epochs.back()) return;
+  lineepoch[s] = trail.epochs.back();
+  auto const row = line(l);
+  trail.rows.insert(trail.rows.end(), row, row + Row::nbWords(nbcols));
+  auto const sup = support(l);
+  unsigned const k = (sup[0] == nzstale) ? 1 : sup[0] + 1;
+  trail.supports.insert(trail.supports.end(), sup, sup + k);
+  trail.supports.push_back(k);
+  trail.undo.push_back(Undo {Undo::Line, 0, uint16_t(s), 0, 0, 0, nullptr});
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::restoreLine(unsigned s) {
+  auto const nbwords = Row::nbWords(nbcols);
+  copy(trail.rows.end() - nbwords, trail.rows.end(), space + s*stride);
+  trail.rows.resize(trail.rows.size() - nbwords);
+  unsigned const k = trail.supports.back();
+  trail.supports.pop_back();
+  copy(trail.supports.end() - k, trail.supports.end(), supspace + s*(nzcap+1));
+  trail.supports.resize(trail.supports.size() - k);
+  if (supspace[s*(nzcap+1)] != nzstale) resetMask(s);
 }
 
-unsigned Matrix::checkZ(unsigned line1, vector<vector<uint8_t>> const & valX, vector<vector<uint8_t>> const & valK) {
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::checkZ(unsigned line1) const {
   for (unsigned l = line1; l-- != 0; ) {
-    unsigned c = 0;
-    while (c < nbcols) {
-      if ((*this)(l,c) != 0) {
-        auto u = abs(columns[c]);
-        int i = u%16;
-        int v = (u/16)%4;
-        int r = (u/16)/4;
-        if (v == 2 && valX[r][i] == 1) break;
-        else if (v == 1 && valK[r][i/4] == 1) break;
-      }
-      ++c;
-    }
-    if (c == nbcols) return l;
+    if (firstWithValue(l, 1) == nbcols) return l;
   }
   return line1;
 }
@@ -171,129 +806,235 @@ unsigned Matrix::checkZ(unsigned line1, vector<vector<uint8_t>> const & valX, ve
 //   return opt;
 // }
 
-unsigned Matrix::checkZ(double * X) {
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::checkZ(double * X) {
   for (unsigned l = 0; l < nblines; ++l) {
     auto const u = abs(front[l]);
     if (X[u] > 0.5) {
-      unsigned c = 0;
-      while (c < nbcols && ((*this)(l,c) == 0 || X[abs(columns[c])] > 0.5)) ++c;
+      unsigned c = nbcols;
+      for (unsigned cc : nonzeros(l)) {
+        if (X[abs(columns[cc])] <= 0.5) {c = cc; break;}
+      }
       if (c < nbcols) swapLineColumn(l,c);
     }
   }
+  auto const keys = kindmasks + 1*maskWords();
   for (unsigned l = 0; l < nblines; ++l) {
-    auto const u = abs(front[l]);
-    if (X[u] > 0.5 && (u/16)%4 == 1) {
-      unsigned c = 0;
-      while (c < nbcols && ((*this)(l,c) == 0 || (abs(columns[c])/16)%4 == 1)) ++c;
-      if (c < nbcols) swapLineColumn(l,c);
+    if (X[abs(front[l])] > 0.5 && kindOf(front[l]) == 1) {
+      // first nonzero column which is not a key variable
+      auto const mask = rowMask(l);
+      for (unsigned w = 0; w < maskWords(); ++w) {
+        if (auto const b = mask[w] & ~keys[w]) {swapLineColumn(l, 64*w + __builtin_ctzll(b)); break;}
+      }
     }
   }
   for (unsigned l = 0; l < nblines; ++l) {
-    if (X[abs(front[l])] > 0.5 || (abs(front[l])/16)%4 != 1) continue;
-    unsigned c = 0;
-    while (c < nbcols && ((*this)(l,c) == 0 || (X[abs(columns[c])] > 0.5 && (abs(columns[c])/16)%4 == 1))) ++c;
+    if (X[abs(front[l])] > 0.5 || kindOf(front[l]) != 1) continue;
+    unsigned c = nbcols;
+    for (unsigned cc : nonzeros(l)) {
+      if (X[abs(columns[cc])] <= 0.5 || kindOf(columns[cc]) != 1) {c = cc; break;}
+    }
     if (c == nbcols) return l;
   }
   for (unsigned l = 0; l < nblines; ++l) {
     if (X[abs(front[l])] > 0.5 /*|| (abs(front[l])/16)%4 == 1*/) continue;
-    unsigned c = 0;
-    while (c < nbcols && ((*this)(l,c) == 0 || X[abs(columns[c])] > 0.5)) ++c;
+    unsigned c = nbcols;
+    for (unsigned cc : nonzeros(l)) {
+      if (X[abs(columns[cc])] <= 0.5) {c = cc; break;}
+    }
     if (c == nbcols) return l;
   }
   return nblines;
 }
 
-void Matrix::swapLines(unsigned l1, unsigned l2) {
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::swapLines(unsigned l1, unsigned l2) {
   swap(front[l1], front[l2]);
-  swap(lines[l1], lines[l2]);
+  swap(slot[l1], slot[l2]);
+  position[front[l1] + maxvar] = l1;
+  position[front[l2] + maxvar] = l2;
+  if (!trail.epochs.empty()) trail.undo.push_back(Undo {Undo::SwapLines, 0, uint16_t(l1), uint16_t(l2), 0, 0, nullptr});
 }
 
-bool Matrix::setAsPivot(int x, unsigned start) {
-  for (unsigned l = start; l < nblines; ++l) {
-    if (front[l] == x) {
-      swap(front[l], front[start]);
-      swap(lines[l], lines[start]);
-      return true;
-    }
-  }
-  for (unsigned c = 0; c < nbcols; ++c) {
-    if (columns[c] == x) {
-      for (unsigned l = start; l < nblines; ++l) {
-        if ((*this)(l,c) != 0) {
-          swapLineColumn(l,c);
-          swap(front[l], front[start]);
-          swap(lines[l], lines[start]);
-          return true;
-        }
-      }
-      return false;
-    }
-  }
-  return false;
+template <unsigned int Poly, unsigned int Dim>
+bool MatrixT<Poly, Dim>::setAsPivot(int x, unsigned start) {
+  return setAsPivot(x, start, nblines);
 }
 
-bool Matrix::setAsPivot(int x, unsigned start, unsigned end) {
-  for (unsigned l = start; l < end; ++l) {
-    if (front[l] == x) {
-      swap(front[l], front[start]);
-      swap(lines[l], lines[start]);
-      return true;
-    }
-  }
-  for (unsigned c = 0; c < nbcols; ++c) {
-    if (columns[c] == x) {
-      for (unsigned l = start; l < end; ++l) {
-        if ((*this)(l,c) != 0) {
-          swapLineColumn(l,c);
-          swap(front[l], front[start]);
-          swap(lines[l], lines[start]);
-          return true;
-        }
-      }
-      return false;
-    }
+template <unsigned int Poly, unsigned int Dim>
+bool MatrixT<Poly, Dim>::setAsPivot(int x, unsigned start, unsigned end) {
+  auto const l = lineOf(x);
+  if (l < nblines) {
+    if (l < start || l >= end) return false;
+    swapLines(l, start);
+    return true;
   }
-  return false;
+  auto const c = columnOf(x);
+  if (c == nbcols) return false;
+  return setColumnAsPivot(c, start, end);
 }
 
-bool Matrix::setColumnAsPivot(unsigned c, unsigned start, unsigned end) {
+template <unsigned int Poly, unsigned int Dim>
+bool MatrixT<Poly, Dim>::setColumnAsPivot(unsigned c, unsigned start, unsigned end) {
   for (unsigned l = start; l < end; ++l) {
     if ((*this)(l,c) != 0) {
       swapLineColumn(l,c);
-      swap(front[l], front[start]);
-      swap(lines[l], lines[start]);
+      swapLines(l, start);
       return true;
     }
   }
   return false;
 }
 
-void Matrix::eraseColumn(unsigned c) {
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::eraseColumn(unsigned c) {
+  auto const n = trail.erased.size();
   nbcols -= 1;
   for (unsigned l = 0; l < nblines; ++l) {
-    (*this)(l,c) = (*this)(l,nbcols);
+    auto const row = line(l);
+    auto const x = (c == nbcols) ? 0 : Row::get(row, nbcols);
+    auto const y = Row::get(row, c);
+    if (x == 0 && y == 0) continue;
+    if (!trail.epochs.empty()) trail.erased.emplace_back(l, y);
+    support(l)[0] = nzstale;
+    Row::set(row, c, x);
+    Row::set(row, nbcols, 0);
   }
+  if (!trail.epochs.empty()) trail.undo.push_back(Undo {Undo::EraseColumn, 0, uint16_t(c), 0, unsigned(trail.erased.size() - n), columns[c], nullptr});
+  position[columns[c] + maxvar] = nopos;
   columns[c] = columns[nbcols];
-  columns.pop_back();
+  if (c < nbcols) position[columns[c] + maxvar] = nblines + c;
+  resetColumn(c);
+  resetColumn(nbcols);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::restoreColumn(unsigned c, int var, unsigned n) {
+  auto const last = nbcols++;
+  columns[last] = columns[c];
+  columns[c] = var;
+  position[var + maxvar] = nblines + c;
+  if (c < last) position[columns[last] + maxvar] = nblines + last;
+  resetColumn(c);
+  resetColumn(last);
+  for (auto it = trail.erased.end() - n; it != trail.erased.end(); ++it) {
+    auto const row = line(it->first);
+    support(it->first)[0] = nzstale;
+    if (c < last) Row::set(row, last, Row::get(row, c));
+    Row::set(row, c, it->second);
+  }
+  trail.erased.resize(trail.erased.size() - n);
+}
+
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::rewind(unsigned mark) {
+  while (trail.undo.size() > mark) {
+    auto const & u = trail.undo.back();
+    switch (u.op) {
+      case Undo::Line: restoreLine(u.i); break;
+      case Undo::SwapLines:
+        swap(front[u.i], front[u.j]);
+        swap(slot[u.i], slot[u.j]);
+        position[front[u.i] + maxvar] = u.i;
+        position[front[u.j] + maxvar] = u.j;
+        break;
+      case Undo::SwapLineColumn:
+        swap(front[u.i], columns[u.j]);
+        position[front[u.i] + maxvar] = u.i;
+        position[columns[u.j] + maxvar] = nblines + u.j;
+        resetColumn(u.j);
+        break;
+      case Undo::EraseColumn: restoreColumn(u.i, u.var, u.n); break;
+      case Undo::Value:
+        *u.cell = u.value;
+        if (abs(u.var) <= maxvar) {
+          values[abs(u.var)] = u.value;
+          if (columnOf(u.var) != nbcols) resetColumn(columnOf(u.var));
+          if (columnOf(-u.var) != nbcols) resetColumn(columnOf(-u.var));
+        }
+        break;
+    }
+    trail.undo.pop_back();
+  }
+  trail.epochs.pop_back();
+}
+
+template <unsigned int Poly, unsigned int Dim>
+bool MatrixT<Poly, Dim>::isLinear(int x, unsigned start) {
+  return dim2(x, -x, start) < 2;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::dim2(int x1, int x2, unsigned start) const {
+  // the coefficients of a front are a unit vector, the ones of a column are read on the lines start..
+  auto const l1 = lineOf(x1), l2 = lineOf(x2);
+  auto const c1 = columnOf(x1), c2 = columnOf(x2);
+  auto const appearsOn = [this, start](unsigned l, unsigned c) {
+    if (l < nblines) return l >= start;
+    if (c == nbcols) return false;
+    for (unsigned i = start; i < nblines; ++i) {
+      if ((*this)(i,c) != 0) return true;
+    }
+    return false;
+  };
+  bool const a1 = appearsOn(l1, c1), a2 = appearsOn(l2, c2);
+  if (!a1 || !a2) return a1 || a2;
+  if (l1 < nblines && l2 < nblines) return l1 == l2 ? 1 : 2;
+  if (l1 < nblines || l2 < nblines) { // x1 (or x2) is the front of l: dependent if the column is zero outside of l
+    auto const l = min(l1, l2);
+    auto const c = min(c1, c2);
+    for (unsigned i = start; i < nblines; ++i) {
+      if (i != l && (*this)(i,c) != 0) return 2;
+    }
+    return 1;
+  }
+  if (c1 == c2) return 1;
+  unsigned i = start;
+  while ((*this)(i,c1) == 0) ++i;
+  auto const ratio = (*this)(i,c2)*(*this)(i,c1).getInverse();
+  for (i = start; i < nblines; ++i) {
+    if ((*this)(i,c2) != ratio*(*this)(i,c1)) return 2;
+  }
+  return 1;
 }
 
-bool Matrix::isLinear(int x, unsigned start) {
-  if (setAsPivot(x, start)) {
-    return !setAsPivot(-x, start+1);
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::echelonizeOn(vector<int> const & vars, unsigned start) {
+  for (auto x : vars) {
+    if (setAsPivot(x, start)) ++start;
   }
-  else return true;
+  return start;
 }
 
-vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> const & mapSK) {
-  unsigned start = 0;
+// The tests are done on the coefficients (dim2), without pivoting: only the removed variables are pivoted
+// and each removal starts again from the beginning since it can make linear the variables already tested
+template <unsigned int Poly, unsigned int Dim>
+unsigned MatrixT<Poly, Dim>::echelonizeOnPairs(vector<int> & vars, unsigned start) {
+  unsigned i = 0, n = vars.size();
+  while (i < n) {
+    if (dim2(vars[i], -vars[i], start) == 2) { // does not linearly appear
+      ++i;
+      continue;
+    }
+    if (setAsPivot(vars[i], start)) ++start; // linearly appear
+    else if (setAsPivot(-vars[i], start)) ++start; // vars[i] does not appear in the system
+    vars[i] = vars[--n];
+    i = 0;
+  }
+  vars.resize(n);
+  return start;
+}
+
+template <unsigned int Poly, unsigned int Dim>
+vector<int> MatrixT<Poly, Dim>::checkK(double * X, double * SK, map<unsigned, unsigned> const & mapSK) {
+  vector<int> unknown;
   vector<int> toprocess1;
   vector<int> toprocess2;
-  for (auto x : front) {
+  for (unsigned l = 0; l < nblines; ++l) {
+    auto const x = front[l];
     if (x >= 0 && X[x] < 0.5) {
       auto it = mapSK.find(x);
-      if (it == mapSK.end()) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
-      }
+      if (it == mapSK.end()) unknown.emplace_back(x); // unknown state variable
       else {
         if (SK[it->second] < 0.5) toprocess2.emplace_back(x);
         else toprocess1.emplace_back(x);
@@ -301,12 +1042,11 @@ vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> cons
     }
     else if (x < 0 && X[-x] > 0.5 && SK[mapSK.at(-x)] < 0.5) toprocess1.emplace_back(x);
   }
-  for (auto x : columns) {
+  for (unsigned c = 0; c < nbcols; ++c) {
+    auto const x = columns[c];
     if (x >= 0 && X[x] < 0.5) {
       auto it = mapSK.find(x);
-      if (it == mapSK.end()) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
-      }
+      if (it == mapSK.end()) unknown.emplace_back(x); // unknown state variable
       else {
         if (SK[it->second] < 0.5) toprocess2.emplace_back(x);
         else toprocess1.emplace_back(x);
@@ -315,99 +1055,47 @@ vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> cons
     else if (x < 0 && X[-x] > 0.5 && SK[mapSK.at(-x)] < 0.5) toprocess1.emplace_back(x);
   }
 
-  unsigned i = 0, n = toprocess2.size();
-  while (i < n) {
-    if (setAsPivot(toprocess2[i], start)) {
-      if (setAsPivot(-toprocess2[i], start+1)) { // does not linearly appear
-        ++i;
-      }
-      else { // linearly appear
-        ++start;
-        toprocess2[i] = toprocess2[--n];
-        i = 0;
-      }
-    }
-    else { // toprocess_v[i] does not appear in the system
-      if (setAsPivot(-toprocess2[i], start)) ++start;
-      toprocess2[i] = toprocess2[--n];
-      i = 0;
-    }
-  }
-
-  toprocess2.resize(n);
-  for (auto x : toprocess1) if (setAsPivot(x, start)) toprocess2.emplace_back(abs(x));
+  // same order as pivoting them during the scan: a pivot only exchanges fronts and columns already visited
+  auto start = echelonizeOn(unknown);
+  start = echelonizeOnPairs(toprocess2, start);
+  for (auto x : toprocess1) if (appears(x, start)) toprocess2.emplace_back(abs(x));
   return toprocess2;
 }
 
-vector<int> Matrix::checkZ2(double * X, unsigned nX, set<unsigned> const & setSK) {
-  unsigned start = 0;
+template <unsigned int Poly, unsigned int Dim>
+vector<int> MatrixT<Poly, Dim>::checkZ2(double * X, unsigned nX, set<unsigned> const & setSK) {
+  vector<int> unknown;
   vector<int> toprocess2;
-  for (auto x : front) {
+  for (unsigned l = 0; l < nblines; ++l) {
+    auto const x = front[l];
     if (x >= 0 && X[x] < 0.5) {
-      if (setSK.count(x) == 0) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
-      }
+      if (setSK.count(x) == 0) unknown.emplace_back(x); // unknown state variable
       else toprocess2.emplace_back(x);
     }
   }
-  for (auto x : columns) {
+  for (unsigned c = 0; c < nbcols; ++c) {
+    auto const x = columns[c];
     if (x >= 0 && X[x] < 0.5) {
-      if (setSK.count(x) == 0) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
-      }
+      if (setSK.count(x) == 0) unknown.emplace_back(x); // unknown state variable
       else {
         toprocess2.emplace_back(x);
       }
     }
   }
 
-  unsigned i = 0, n = toprocess2.size();
-  while (i < n) {
-    if (setAsPivot(toprocess2[i], start)) {
-      if (setAsPivot(-toprocess2[i], start+1)) { // does not linearly appear
-        ++i;
-      }
-      else { // linearly appear
-        ++start;
-        toprocess2[i] = toprocess2[--n];
-        i = 0;
-      }
-    }
-    else { // toprocess_v[i] does not appear in the system
-      if (setAsPivot(-toprocess2[i], start)) ++start;
-      toprocess2[i] = toprocess2[--n];
-      i = 0;
-    }
-  }
-  toprocess2.resize(n);
-  if (n == 0) return toprocess2;
+  // same order as pivoting them during the scan: a pivot only exchanges fronts and columns already visited
+  auto start = echelonizeOn(unknown);
+  start = echelonizeOnPairs(toprocess2, start);
+  if (toprocess2.empty()) return toprocess2;
 
   for (unsigned j = 0; j < nX; ++j) {
     if (X[j] < 0.5) continue;
     auto back_start = start;
     auto res = toprocess2;
     if (setAsPivot(j, start) || (setSK.count(j) != 0 && setAsPivot(-j, start))) {
-      i = 0; n = toprocess2.size();
       ++start;
       if (setSK.count(j) != 0 && setAsPivot(-j, start)) ++start;
-      while (i < n) {
-        if (setAsPivot(toprocess2[i], start)) {
-          if (setAsPivot(-toprocess2[i], start+1)) { // does not linearly appear
-            ++i;
-          }
-          else { // linearly appear
-            ++start;
-            toprocess2[i] = toprocess2[--n];
-            i = 0;
-          }
-        }
-        else { // toprocess_v[i] does not appear in the system
-          if (setAsPivot(-toprocess2[i], start)) ++start;
-          toprocess2[i] = toprocess2[--n];
-          i = 0;
-        }
-      }
-      toprocess2.resize(n);
+      start = echelonizeOnPairs(toprocess2, start);
     }
     if (toprocess2.empty()) {
       toprocess2 = move(res);
@@ -418,7 +1106,8 @@ vector<int> Matrix::checkZ2(double * X, unsigned nX, set<unsigned> const & setSK
   return toprocess2;
 }
 
-void Matrix::printLine(unsigned i) {
+template <unsigned int Poly, unsigned int Dim>
+void MatrixT<Poly, Dim>::printLine(unsigned i) {
   printVar(cout, front[i]);
   for (unsigned j = 0; j < nbcols; ++j) {
     if ((*this)(i,j) != 0) {
@@ -431,20 +1120,34 @@ void Matrix::printLine(unsigned i) {
   cout << endl;
 }
 
-ostream& operator<<( ostream &flux, Matrix const& mat)
+template <unsigned int Poly, unsigned int Dim>
+ostream& operator<<( ostream &flux, MatrixT<Poly, Dim> const& mat)
 {
 	for (unsigned i = 0; i < mat.nblines; ++i) {
     //flux << mat.front[i];
-    printVar(flux, mat.front[i]);
+    printVar(flux, mat.getFront(i));
     for (unsigned j = 0; j < mat.nbcols; ++j) {
       if (mat(i,j) != 0) {
         flux << " + ";
         if (mat(i,j) != 1) flux << mat(i,j) << ".";
         //flux << mat.columns[j];
-        printVar(flux, mat.columns[j]);
+        printVar(flux, mat.getColumns(j));
       }
     }
     flux << endl;
   }
 	return flux;
 }
+
+
+// Fields available at runtime (see GFieldDispatch)
+template class MatrixT<0x02>;
+template class MatrixT<0x13>;
+template class MatrixT<0x11b>;
+// the rows of F_2 and GF(16) stored one coefficient per byte, the reference of the packed ones in the tests
+template class MatrixT<0x02, 8>;
+template class MatrixT<0x13, 8>;
+
+template ostream& operator<<( ostream &flux, MatrixT<0x02> const& mat);
+template ostream& operator<<( ostream &flux, MatrixT<0x13> const& mat);
+template ostream& operator<<( ostream &flux, MatrixT<0x11b> const& mat);
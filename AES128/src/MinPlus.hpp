@@ -0,0 +1,130 @@
+#ifndef DEF_MINPLUS
+#define DEF_MINPLUS
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Kernels of the passes of the dynamic programs over rows of n cells of bounds (uint8_t).
+// The additions saturate at 255, and a cell at or above the bound is saturated too: min then leaves it out,
+// which replaces the test "if (src >= bound) continue" of the scalar passes.
+
+inline uint8_t addSat(uint8_t a, uint8_t b) {
+  unsigned s = unsigned(a) + b;
+  return (s > 255) ? 255 : s;
+}
+
+// dst = min(dst, src + add) on the cells where src + add < bound
+inline void minBelow(uint8_t * dst, uint8_t const * src, uint8_t add, uint8_t bound, unsigned n) {
+  unsigned i = 0;
+#if defined(__AVX512BW__)
+  {
+    __m512i const a = _mm512_set1_epi8(char(add));
+    __m512i const b = _mm512_set1_epi8(char(bound));
+    for (; i + 64 <= n; i += 64) {
+      __m512i const s = _mm512_adds_epu8(_mm512_loadu_si512(src + i), a);
+      __m512i const d = _mm512_loadu_si512(dst + i);
+      _mm512_storeu_si512(dst + i, _mm512_mask_min_epu8(d, _mm512_cmplt_epu8_mask(s, b), d, s));
+    }
+  }
+#endif
+#if defined(__AVX2__)
+  {
+    __m256i const a = _mm256_set1_epi8(char(add));
+    __m256i const b = _mm256_set1_epi8(char(bound));
+    for (; i + 32 <= n; i += 32) {
+      __m256i s = _mm256_adds_epu8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i)), a);
+      s = _mm256_or_si256(s, _mm256_cmpeq_epi8(_mm256_max_epu8(s, b), s)); // s >= bound -> 255
+      __m256i const d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_min_epu8(d, s));
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    uint8_t const s = addSat(src[i], add);
+    if (s < bound && s < dst[i]) dst[i] = s;
+  }
+}
+
+// dst = src + add
+inline void addAll(uint8_t * dst, uint8_t const * src, uint8_t add, unsigned n) {
+  unsigned i = 0;
+#if defined(__AVX512BW__)
+  {
+    __m512i const a = _mm512_set1_epi8(char(add));
+    for (; i + 64 <= n; i += 64) _mm512_storeu_si512(dst + i, _mm512_adds_epu8(_mm512_loadu_si512(src + i), a));
+  }
+#endif
+#if defined(__AVX2__)
+  {
+    __m256i const a = _mm256_set1_epi8(char(add));
+    for (; i + 32 <= n; i += 32) {
+      __m256i const s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_adds_epu8(s, a));
+    }
+  }
+#endif
+  for (; i < n; ++i) dst[i] = addSat(src[i], add);
+}
+
+// dst = min(src1 + add1, src2 + add2)
+inline void minOfAdds(uint8_t * dst, uint8_t const * src1, uint8_t add1, uint8_t const * src2, uint8_t add2, unsigned n) {
+  unsigned i = 0;
+#if defined(__AVX512BW__)
+  {
+    __m512i const a1 = _mm512_set1_epi8(char(add1));
+    __m512i const a2 = _mm512_set1_epi8(char(add2));
+    for (; i + 64 <= n; i += 64) {
+      __m512i const s1 = _mm512_adds_epu8(_mm512_loadu_si512(src1 + i), a1);
+      __m512i const s2 = _mm512_adds_epu8(_mm512_loadu_si512(src2 + i), a2);
+      _mm512_storeu_si512(dst + i, _mm512_min_epu8(s1, s2));
+    }
+  }
+#endif
+#if defined(__AVX2__)
+  {
+    __m256i const a1 = _mm256_set1_epi8(char(add1));
+    __m256i const a2 = _mm256_set1_epi8(char(add2));
+    for (; i + 32 <= n; i += 32) {
+      __m256i const s1 = _mm256_adds_epu8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(src1 + i)), a1);
+      __m256i const s2 = _mm256_adds_epu8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(src2 + i)), a2);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_min_epu8(s1, s2));
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    uint8_t const s1 = addSat(src1[i], add1), s2 = addSat(src2[i], add2);
+    dst[i] = (s1 < s2) ? s1 : s2;
+  }
+}
+
+// row = row + add on the cells where row < bound
+inline void addBelow(uint8_t * row, uint8_t add, uint8_t bound, unsigned n) {
+  unsigned i = 0;
+#if defined(__AVX512BW__)
+  {
+    __m512i const a = _mm512_set1_epi8(char(add));
+    __m512i const b = _mm512_set1_epi8(char(bound));
+    for (; i + 64 <= n; i += 64) {
+      __m512i const r = _mm512_loadu_si512(row + i);
+      _mm512_storeu_si512(row + i, _mm512_mask_adds_epu8(r, _mm512_cmplt_epu8_mask(r, b), r, a));
+    }
+  }
+#endif
+#if defined(__AVX2__)
+  {
+    __m256i const b = _mm256_set1_epi8(char(bound));
+    __m256i const a = _mm256_set1_epi8(char(add));
+    for (; i + 32 <= n; i += 32) {
+      __m256i const r = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row + i));
+      __m256i const above = _mm256_cmpeq_epi8(_mm256_max_epu8(r, b), r); // r >= bound
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(row + i), _mm256_adds_epu8(r, _mm256_andnot_si256(above, a)));
+    }
+  }
+#endif
+  for (; i < n; ++i) if (row[i] < bound) row[i] = addSat(row[i], add);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef DEF_TRANSITIONS
+#define DEF_TRANSITIONS
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Transitions of ShiftRows between the states of the 4 columns (a state counts the active bytes of each column,
+// digit c in base 5), compiled once and shared by updateSR and inv_updateSR.
+// An activity pattern p of the 16 bytes (bit 4*row + col, as valX) goes from the state src(p) (its columns) to the
+// state dst(p) after ShiftRows (the byte (row, col) goes to the column (col - row)%4).
+struct SRGraph
+{
+  // canon[state]: the state with the same digits sorted (digit 0 the smallest, so canon[state] >= state), whose
+  // sources updateSR takes for state
+  std::array<uint16_t, 5*5*5*5> canon;
+  // sources of the destination d: the distinct src(p), increasing, sources[first[d] .. first[d+1])
+  std::vector<uint32_t> first;
+  std::vector<uint16_t> sources;
+  // patterns giving the source sources[e]: patterns[firstPattern[e] .. firstPattern[e+1])
+  std::vector<uint32_t> firstPattern;
+  std::vector<uint16_t> patterns;
+
+  SRGraph() : first(5*5*5*5 + 1, 0) {
+    static unsigned const mypow[4] = {1, 5, 5*5, 5*5*5};
+
+    std::vector<std::array<uint16_t, 3>> all; // (dst, src, pattern)
+    all.reserve(1u << 16);
+    for (unsigned p = 0; p < (1u << 16); ++p) {
+      unsigned src = 0, dst = 0;
+      for (unsigned row = 0; row < 4; ++row) {
+        for (unsigned col = 0; col < 4; ++col) {
+          if (((p >> (4*row + col)) & 1) == 0) continue;
+          src += mypow[col];
+          dst += mypow[(col + 4 - row)%4];
+        }
+      }
+      all.push_back({uint16_t(dst), uint16_t(src), uint16_t(p)});
+    }
+    std::sort(all.begin(), all.end());
+
+    patterns.reserve(all.size());
+    for (unsigned i = 0; i < all.size(); ++i) {
+      if (i == 0 || all[i][0] != all[i-1][0] || all[i][1] != all[i-1][1]) {
+        sources.push_back(all[i][1]);
+        firstPattern.push_back(patterns.size());
+        first[all[i][0] + 1] = sources.size();
+      }
+      patterns.push_back(all[i][2]);
+    }
+    firstPattern.push_back(patterns.size());
+
+    for (unsigned state = 0; state < 5*5*5*5; ++state) {
+      unsigned digits[4];
+      for (unsigned c = 0; c < 4; ++c) digits[c] = (state/mypow[c])%5;
+      std::sort(&digits[0], &digits[0] + 4);
+      canon[state] = 0;
+      for (unsigned c = 0; c < 4; ++c) canon[state] += digits[c]*mypow[c];
+    }
+  }
+};
+
+inline SRGraph const & srGraph() {
+  static SRGraph const graph;
+  return graph;
+}
+
+#endif
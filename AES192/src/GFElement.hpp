@@ -29,307 +29,98 @@
 #include "GField.hpp"
 
 /**
- *  @brief     Represent an element of a finite field GF(2^n)
+ *  @brief     Represent an element of the finite field GF(2^n) defined by the polynomial Poly
+ *  @details   The field is a template parameter so that one binary holds the code of several fields;
+ *             use GFieldDispatch() to pick one at runtime. Poly = 0x02 gives the field F_2.
  *  @warning   It is assumed that operators take elements that belong to the same field.
  */
 
-class GFElement
+template <unsigned int Poly>
+class GFElementT
 {
 	public:
-		GFElement() {};
-		GFElement(const GFSymbol value) : m_value(value) {};
-		GFElement(GFElement const & element) : m_value(element.m_value) {};
+		typedef GField<Poly> Field;
 		
-		GFElement& operator=(const GFElement element);
-		GFElement& operator=(const GFSymbol value);
+		GFElementT() {};
+		GFElementT(const GFSymbol value) : m_value(value) {};
+		GFElementT(GFElementT const & element) : m_value(element.m_value) {};
 		
-		~GFElement() {};
+		GFElementT& operator=(const GFElementT element) {m_value = element.m_value; return *this;};
+		GFElementT& operator=(const GFSymbol value) {m_value = value; return *this;};
 		
-		void inverse();
-		GFElement getInverse() const;
-#if (GF_POLY != 0x02)
-		static GFSymbol inverse(const GFSymbol value) {return m_gf.inverse(value);};
-#else
-		static GFSymbol inverse(const GFSymbol value) {return value;};
-#endif
-		static unsigned int getDim() { return m_gf.getDim(); };
-		static unsigned int getCard() { return m_gf.getCard(); };
+		~GFElementT() {};
+		
+		GFSymbol getValue() const {return m_value;};
+		
+		void inverse() {m_value = inverse(m_value);};
+		GFElementT getInverse() const {return GFElementT(inverse(m_value));};
+		static GFSymbol inverse(const GFSymbol value) {return (Poly == 0x02) ? value : Field::inverse(value);};
+		static GFSymbol multiply(const GFSymbol val1, const GFSymbol val2) {return (Poly == 0x02) ? (val1 & val2) : Field::multiply(val1, val2);};
+		static unsigned int getDim() { return Field::getDim(); };
+		static unsigned int getCard() { return Field::getCard(); };
+		
+		// Row operations over n consecutive elements: dst += coef*src and row *= coef
+		static void row_axpy(GFElementT * dst, GFElementT const * src, const GFElementT coef, const unsigned int n)
+		{
+			Field::row_axpy(reinterpret_cast<GFSymbol *>(dst), reinterpret_cast<GFSymbol const *>(src), coef.m_value, n);
+		};
+		static void row_scale(GFElementT * row, const GFElementT coef, const unsigned int n)
+		{
+			Field::row_scale(reinterpret_cast<GFSymbol *>(row), coef.m_value, n);
+		};
 		
-		GFElement& operator+=(const GFElement element);
-		GFElement& operator-=(const GFElement element);
-		GFElement& operator*=(const GFElement element);
-		GFElement& operator/=(const GFElement element);
+		GFElementT& operator+=(const GFElementT element) {m_value ^= element.m_value; return *this;};
+		GFElementT& operator-=(const GFElementT element) {m_value ^= element.m_value; return *this;};
+		GFElementT& operator*=(const GFElementT element) {m_value = multiply(m_value, element.m_value); return *this;};
+		GFElementT& operator/=(const GFElementT element) {m_value = multiply(m_value, inverse(element.m_value)); return *this;};
 		
-		GFElement& operator+=(const GFSymbol value);
-		GFElement& operator-=(const GFSymbol value);
-		GFElement& operator*=(const GFSymbol value);
-		GFElement& operator/=(const GFSymbol value);
+		GFElementT& operator+=(const GFSymbol value) {m_value ^= value; return *this;};
+		GFElementT& operator-=(const GFSymbol value) {m_value ^= value; return *this;};
+		GFElementT& operator*=(const GFSymbol value) {m_value = multiply(value, m_value); return *this;};
+		GFElementT& operator/=(const GFSymbol value) {m_value = multiply(inverse(value), m_value); return *this;};
 		
 	
 	private:
 		GFSymbol m_value;
-		
-		const static GField m_gf; 
 	
 		
-	friend std::ostream& operator<<( std::ostream &flux, const GFElement var);
+	friend std::ostream& operator<<( std::ostream &flux, const GFElementT var)
+	{
+		flux << std::hex << std::setfill('0') << std::setw(2) << static_cast<unsigned int>(var.m_value) << std::dec;
+		return flux;
+	};
 	
-	friend GFElement operator+(const GFElement element1, const GFElement element2);
-	friend GFElement operator-(const GFElement element1, const GFElement element2);
-	friend GFElement operator*(const GFElement element1, const GFElement element2);
-	friend GFElement operator/(const GFElement element1, const GFElement element2);
+	friend GFElementT operator+(const GFElementT element1, const GFElementT element2) { return GFElementT(element1.m_value ^ element2.m_value); };
+	friend GFElementT operator-(const GFElementT element1, const GFElementT element2) { return GFElementT(element1.m_value ^ element2.m_value); };
+	friend GFElementT operator*(const GFElementT element1, const GFElementT element2) { return GFElementT(multiply(element1.m_value, element2.m_value)); };
+	friend GFElementT operator/(const GFElementT element1, const GFElementT element2) { return GFElementT(multiply(inverse(element2.m_value), element1.m_value)); };
 	
-	friend GFElement operator+(const GFElement element, const GFSymbol val);
-	friend GFElement operator-(const GFElement element, const GFSymbol val);
-	friend GFElement operator*(const GFElement element, const GFSymbol val);
-	friend GFElement operator/(const GFElement element, const GFSymbol val);
+	friend GFElementT operator+(const GFElementT element, const GFSymbol val) { return GFElementT(element.m_value ^ val); };
+	friend GFElementT operator-(const GFElementT element, const GFSymbol val) { return GFElementT(element.m_value ^ val); };
+	friend GFElementT operator*(const GFElementT element, const GFSymbol val) { return GFElementT(multiply(val, element.m_value)); };
+	friend GFElementT operator/(const GFElementT element, const GFSymbol val) { return GFElementT(multiply(inverse(val), element.m_value)); };
 	
-	friend GFElement operator+(const GFSymbol val, const GFElement element);
-	friend GFElement operator-(const GFSymbol val, const GFElement element);
-	friend GFElement operator*(const GFSymbol val, const GFElement element);
-	friend GFElement operator/(const GFSymbol val, const GFElement element);
+	friend GFElementT operator+(const GFSymbol val, const GFElementT element) { return GFElementT(element.m_value ^ val); };
+	friend GFElementT operator-(const GFSymbol val, const GFElementT element) { return GFElementT(element.m_value ^ val); };
+	friend GFElementT operator*(const GFSymbol val, const GFElementT element) { return GFElementT(multiply(val, element.m_value)); };
+	friend GFElementT operator/(const GFSymbol val, const GFElementT element) { return GFElementT(multiply(val, inverse(element.m_value))); };
 	
-	friend bool operator==(const GFElement element1, const GFElement element2) { return (element1.m_value == element2.m_value); }; 	
-	friend bool operator==(const GFElement element, const GFSymbol val) { return (element.m_value == val); }; //useful to try == 1 or == 0
-	friend bool operator==(const GFSymbol val, const GFElement element) { return (element.m_value == val); }; 
+	friend bool operator==(const GFElementT element1, const GFElementT element2) { return (element1.m_value == element2.m_value); }; 	
+	friend bool operator==(const GFElementT element, const GFSymbol val) { return (element.m_value == val); }; //useful to try == 1 or == 0
+	friend bool operator==(const GFSymbol val, const GFElementT element) { return (element.m_value == val); }; 
 	
-	friend bool operator!=(const GFElement element1, const GFElement element2) { return (element1.m_value != element2.m_value); }; 	
-	friend bool operator!=(const GFElement element, const GFSymbol val) { return (element.m_value != val); }; 
-	friend bool operator!=(const GFSymbol val, const GFElement element) { return (element.m_value != val); };
+	friend bool operator!=(const GFElementT element1, const GFElementT element2) { return (element1.m_value != element2.m_value); }; 	
+	friend bool operator!=(const GFElementT element, const GFSymbol val) { return (element.m_value != val); }; 
+	friend bool operator!=(const GFSymbol val, const GFElementT element) { return (element.m_value != val); };
 	
-	friend bool operator<(const GFElement element1, const GFElement element2) { return (element1.m_value < element2.m_value); }; // to use std::map, std::set
+	friend bool operator<(const GFElementT element1, const GFElementT element2) { return (element1.m_value < element2.m_value); }; // to use std::map, std::set
 };
 
 
+// Elements of the AES field, the one of the AES systems of equations
+typedef GFElementT<0x11b> GFElement;
 
-// Operators
-
-inline GFElement& GFElement::operator=(const GFElement element) 
-{
-    m_value = element.m_value;
-    return *this; 
-}
-
-inline GFElement& GFElement::operator=(const GFSymbol value)
-{
-	m_value = value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator+=(const GFElement element)
-{
-	m_value ^= element.m_value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator-=(const GFElement element)
-{
-	m_value ^= element.m_value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator+=(const GFSymbol value)
-{
-	m_value ^= value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator-=(const GFSymbol value)
-{
-	m_value ^= value;
-	return *this;
-}
-
-#if (GF_POLY != 0x02) // not the finite field F_2
-
-inline GFElement& GFElement::operator*=(const GFElement element)
-{
-	m_value = m_gf.multiply(m_value,element.m_value);
-	return *this;
-}
-
-inline GFElement& GFElement::operator/=(const GFElement element)
-{
-	m_value = m_gf.multiply(m_value,m_gf.inverse(element.m_value));
-	return *this;
-}
-
-inline GFElement& GFElement::operator*=(const GFSymbol value)
-{
-	m_value = m_gf.multiply(value,m_value);
-	return *this;
-}
-
-inline GFElement& GFElement::operator/=(const GFSymbol value)
-{
-	m_value = m_gf.multiply(m_gf.inverse(value),m_value);
-	return *this;
-}
-
-#else // the finite field F_2
-
-inline GFElement& GFElement::operator*=(const GFElement element)
-{
-	m_value &= element.m_value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator/=(const GFElement element)
-{
-	m_value &= element.m_value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator*=(const GFSymbol value)
-{
-	m_value &= value;
-	return *this;
-}
-
-inline GFElement& GFElement::operator/=(const GFSymbol value)
-{
-	m_value &= value;
-	return *this;
-}
-
-#endif
-
-
-
-// Member Functions 
-
-#if (GF_POLY != 0x02) // not the finite field F_2
-
-inline GFElement GFElement::getInverse() const
-{
-	return GFElement(m_gf.inverse(m_value));
-}
-
-inline void GFElement::inverse()
-{
-	m_value = m_gf.inverse(m_value);
-}
-
-#else
-
-inline GFElement GFElement::getInverse() const
-{
-	return *this;
-}
-
-inline void GFElement::inverse()
-{
-}
-
-#endif
-
-
-// Friend Functions 
-
-inline GFElement operator+(const GFElement element1, const GFElement element2)
-{
-	return GFElement(element1.m_value ^ element2.m_value);
-}
-
-inline GFElement operator-(const GFElement element1, const GFElement element2)
-{
-	return GFElement(element1.m_value ^ element2.m_value);
-}
-
-inline GFElement operator+(const GFElement element, const GFSymbol val)
-{
-	return GFElement(element.m_value ^ val);
-}
-
-inline GFElement operator-(const GFElement element, const GFSymbol val)
-{
-	return GFElement(element.m_value ^ val);
-}
-	
-inline GFElement operator+(const GFSymbol val, const GFElement element)
-{
-	return GFElement(element.m_value ^ val);
-}
-
-inline GFElement operator-(const GFSymbol val, const GFElement element)
-{
-	return GFElement(element.m_value ^ val);
-}
-
-#if (GF_POLY != 0x02) // not the finite field F_2
-
-inline GFElement operator*(const GFElement element1, const GFElement element2)
-{
-	return GFElement(GFElement::m_gf.multiply(element1.m_value,element2.m_value));
-}
-
-inline GFElement operator/(const GFElement element1, const GFElement element2)
-{
-	return GFElement(GFElement::m_gf.multiply(GFElement::m_gf.inverse(element2.m_value), element1.m_value));
-}
-
-inline GFElement operator*(const GFElement element, const GFSymbol val)
-{
-	return GFElement(GFElement::m_gf.multiply(val,element.m_value));
-}
-
-inline GFElement operator/(const GFElement element, const GFSymbol val)
-{
-	return GFElement(GFElement::m_gf.multiply(GFElement::m_gf.inverse(val),element.m_value));
-}
-
-inline GFElement operator*(const GFSymbol val, const GFElement element)
-{
-	return GFElement(GFElement::m_gf.multiply(val,element.m_value));
-}
-
-inline GFElement operator/(const GFSymbol val, const GFElement element)
-{
-	return GFElement(GFElement::m_gf.multiply(val,GFElement::m_gf.inverse(element.m_value)));
-}
-
-
-#else
-
-inline GFElement operator*(const GFElement element1, const GFElement element2)
-{
-	return GFElement(element1.m_value & element2.m_value);
-}
-
-inline GFElement operator/(const GFElement element1, const GFElement element2)
-{
-	return GFElement(element1.m_value & element2.m_value);
-}
-
-inline GFElement operator*(const GFElement element, const GFSymbol val)
-{
-	return GFElement(element.m_value & val);
-}
-
-inline GFElement operator/(const GFElement element, const GFSymbol val)
-{
-	return GFElement(element.m_value & val);
-}
-
-inline GFElement operator*(const GFSymbol val, const GFElement element)
-{
-	return GFElement(element.m_value & val);
-}
-
-inline GFElement operator/(const GFSymbol val, const GFElement element)
-{
-	return GFElement(element.m_value & val);
-}
-
-#endif
-
-inline std::ostream& operator<<( std::ostream &flux, const GFElement var)
-{
-	flux << std::hex << std::setfill('0') << std::setw(2) << static_cast<unsigned int>(var.m_value) << std::dec;
-	return flux;
-}
-
-
+static_assert(sizeof(GFElement) == sizeof(GFSymbol), "rows of GFElement are handed to the GField kernels as rows of GFSymbol");
 
 
 #endif
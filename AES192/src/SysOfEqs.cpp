@@ -1,261 +1,166 @@
+#include <cstdlib>
+#include <string>
+#include <stdexcept>
+
 #include "SysOfEqs.hpp"
 
 using namespace std;
 
-// system of equations of AES-192
-Matrix AES192eqs(unsigned R) {
-  GFElement mc [4] = {2, 3, 1, 1};
-  vector<unsigned> shiftRows ({0, 1, 2, 3, 7, 4, 5, 6, 10, 11, 8, 9, 13, 14, 15, 12});
-  vector<unsigned> shiftRowsInv (16);
-  for (unsigned i = 0; i < 16; ++i) shiftRowsInv[shiftRows[i]] = i;
+#ifndef GF_POLY
+#define GF_POLY 0x11b
+#endif
 
-  vector<vector<pair<GFElement, int>>> sys;
-  // P + K0 = X0
-  for (unsigned i = 0; i < 16; ++i) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, i);
-    v.emplace_back(1, i+16);
-    v.emplace_back(1, i+32);
-    sys.emplace_back(move(v));
-  }
-  for (unsigned r = 0; r < R-1; ++r) {
-    for (unsigned c = 0; c < 4; ++c) {
-      for (unsigned i = 0; i < 4; ++i) {
-        vector<pair<GFElement, int>> v;
-        for (unsigned j = 0; j < 4; ++j) v.emplace_back(mc[(j + 4 - i)%4], (4*r+3)*16 + shiftRowsInv[4*j + c]);
-        v.emplace_back(1, (4*r+4)*16 + 4*i + c);
-        sys.emplace_back(move(v));
-      }
-    }
-  }
+// AES: ShiftRows moves the cell i to shiftRows[i], MixColumns is the circulant matrix (2 3 1 1)
+static array<unsigned, 16> const shiftRows {0, 1, 2, 3, 7, 4, 5, 6, 10, 11, 8, 9, 13, 14, 15, 12};
+static array<GFSymbol, 16> const mixColumns {2, 3, 1, 1, 1, 2, 3, 1, 1, 1, 2, 3, 3, 1, 1, 2};
 
-  for (unsigned r = 0; r < R; ++r) {
-    for (unsigned i = 0; i < 16; ++i) {
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, (4*r+3)*16 + i);
-      v.emplace_back(1, -((4*r+2)*16 + i));
-      sys.emplace_back(move(v));
-    }
-  }
+Cipher const AES128cipher {shiftRows, mixColumns, 4, false, true};
+Cipher const AES192cipher {shiftRows, mixColumns, 6, true, false};
+Cipher const AES256cipher {shiftRows, mixColumns, 8, true, true};
 
-  for (unsigned i = 0; i < 16; ++i) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, (4*R-1)*16 + i);
-    v.emplace_back(1, (4*R)*16 + shiftRows[i]);
-    sys.emplace_back(move(v));
-  }
-  for (unsigned r = 0; r < R; ++r) {
-    for (unsigned i = 0; i < 16; ++i) {
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, (4*r+4)*16 + i);
-      v.emplace_back(1, (4*r+5)*16 + i);
-      v.emplace_back(1, (4*r+6)*16 + i);
-      sys.emplace_back(move(v));
-    }
-  }
-    for (unsigned r = 1; r < R; ++r) {
-        for (unsigned i = 0; i < 16; ++i) {
-          if (4*r + (i%4) < 6) continue;
-          if ((4*r + (i%4))%6 == 0) {
-            if (i%4 == 0) {
-              vector<pair<GFElement, int>> v;
-              v.emplace_back(1, 16*(4*r + 1) + i);
-              v.emplace_back(1, -(16*(4*(r-1) + 1) + ((i+7)%16)));
-              v.emplace_back(1, 16*(4*(r-2) + 1) + (i+2));
-              sys.emplace_back(move(v));
-            }
-            else {
-              vector<pair<GFElement, int>> v;
-              v.emplace_back(1, 16*(4*r + 1) + i);
-              v.emplace_back(1, -(16*(4*r + 1) + ((i+3)%16)));
-              v.emplace_back(1, 16*(4*(r-1) + 1) + (i-2));
-              sys.emplace_back(move(v));
-            }
-          }
-          else {
-            vector<pair<GFElement, int>> v;
-            v.emplace_back(1, 16*(4*r + 1) + i);
-            if (i%4 == 0) v.emplace_back(1, 16*(4*(r-1) + 1) + i + 3);
-            else v.emplace_back(1, 16*(4*r + 1) + i - 1);
-            if (i%4 < 2) v.emplace_back(1, 16*(4*(r-2) + 1) + (i+2));
-            else v.emplace_back(1, 16*(4*(r-1) + 1) + (i-2));
-            sys.emplace_back(move(v));
-          }
-        }
-    }
-    return Matrix(sys);
+unsigned fieldOfRun() {
+  char const * field = getenv("AESCM_FIELD");
+  if (field == nullptr || *field == '\0') return GF_POLY;
+  char * end;
+  auto const poly = strtoul(field, &end, 0);
+  if (*end != '\0') throw invalid_argument(string("AESCM_FIELD: not a polynomial: ") + field);
+  return poly;
 }
 
- /* for (unsigned r = 1; r <= R; ++r) {
-    for (unsigned c = 0; c < 4; ++c) {
-      if (c + 4*r < 6) continue;
-      unsigned u0 = (4*r + 1)*16 + 4*c;
-      unsigned u1 = (c == 0) ? (4*(r-1) + 1)*16 + 4*3 : u0 - 4;
-      unsigned u2 = (c >= 2) ? (4*(r-1) + 1)*16 + 4*(c-2) : (4*(r-2) + 1)*16 + 4*(c+2);
-      if ((c + 4*r)%6 == 0) {
-        for (unsigned i = 0; i < 4; ++i) {
-          unsigned j = ((i+1)%4);
-          vector<pair<GFElement, int>> v;
-          v.emplace_back(1, -(u1 + j));
-          v.emplace_back(1, u0 + i);
-          v.emplace_back(1, u2 + i);
-          sys.emplace_back(move(v));
-        }
-      }
-      else {
-        for (unsigned i = 0; i < 4; ++i) {
-          vector<pair<GFElement, int>> v;
-          v.emplace_back(1, u0 + i);
-          v.emplace_back(1, u1 + i);
-          v.emplace_back(1, u2 + i);
-          sys.emplace_back(move(v));
-        }
-      }
-    }
-  }*/
-
-// system of equations of AES-256
-Matrix AES256eqs(unsigned R) {
-  GFElement mc [4] = {2, 3, 1, 1};
-  vector<unsigned> shiftRows ({0, 1, 2, 3, 7, 4, 5, 6, 10, 11, 8, 9, 13, 14, 15, 12});
-  vector<unsigned> shiftRowsInv (16);
-  for (unsigned i = 0; i < 16; ++i) shiftRowsInv[shiftRows[i]] = i;
+template <unsigned int Poly>
+typename MatrixT<Poly>::Equations equations(Cipher const & cipher, unsigned r0, unsigned r1, bool last) {
+  unsigned const bits = 31 - __builtin_clz(Poly);
+  for (auto c : cipher.mixColumns) {
+    if ((c >> bits) != 0) throw invalid_argument("equations: the MixColumns coefficient " + to_string(c) + " is not in the field");
+  }
+  // variable of the cell i of the state Z (kind 0), K (1), X (2) or Y (3) of round r (see Matrix::kindOf)
+  auto const var = [](unsigned r, unsigned kind, unsigned i) {return int(16*(4*r + kind) + i);};
+  array<unsigned, 16> shiftRowsInv;
+  for (unsigned i = 0; i < 16; ++i) shiftRowsInv[cipher.shiftRows[i]] = i;
 
-  vector<vector<pair<GFElement, int>>> sys;
-  // P + K0 = X0
-  for (unsigned i = 0; i < 16; ++i) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, i);
-    v.emplace_back(1, i+16);
-    v.emplace_back(1, i+32);
-    sys.emplace_back(move(v));
+  typename MatrixT<Poly>::Equations sys;
+  // Z_r + K_r = X_r (Z_0 is the plaintext)
+  for (unsigned r = r0; r < r1 || (r == r1 && last && cipher.lastKeyAddition); ++r) {
+    for (unsigned i = 0; i < 16; ++i) {
+      sys.add(1, var(r, 0, i));
+      sys.add(1, var(r, 1, i));
+      sys.add(1, var(r, 2, i));
+      sys.close();
+    }
   }
-
-  for (unsigned r = 0; r < R; ++r) {
+  // Y_r = S(X_r)
+  for (unsigned r = r0; r < r1; ++r) {
     for (unsigned i = 0; i < 16; ++i) {
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, (4*r+3)*16 + i);
-      v.emplace_back(1, -((4*r+2)*16 + i));
-      sys.emplace_back(move(v));
+      sys.add(1, var(r, 3, i));
+      sys.add(1, -var(r, 2, i));
+      sys.close();
     }
   }
-
-  for (unsigned r = 0; r < R-1; ++r) {
+  // Z_{r+1} = MixColumns(ShiftRows(Y_r)), without MixColumns in the last round
+  for (unsigned r = (r0 > 0) ? r0-1 : 0; r + 1 < r1; ++r) {
     for (unsigned c = 0; c < 4; ++c) {
       for (unsigned i = 0; i < 4; ++i) {
-        vector<pair<GFElement, int>> v;
-        for (unsigned j = 0; j < 4; ++j) v.emplace_back(mc[(j + 4 - i)%4], (4*r+3)*16 + shiftRowsInv[4*j + c]);
-        v.emplace_back(1, (4*r+4)*16 + 4*i + c);
-        sys.emplace_back(move(v));
+        for (unsigned j = 0; j < 4; ++j) sys.add(cipher.mixColumns[4*i + j], var(r, 3, shiftRowsInv[4*j + c]));
+        sys.add(1, var(r+1, 0, 4*i + c));
+        sys.close();
       }
     }
   }
-  for (unsigned i = 0; i < 16; ++i) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, (4*R-1)*16 + i);
-    v.emplace_back(1, (4*R)*16 + shiftRows[i]);
-    sys.emplace_back(move(v));
-  }
-  for (unsigned r = 0; r < R; ++r) {
-    for (unsigned i = 0; i < 16; ++i) {
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, (4*r+4)*16 + i);
-      v.emplace_back(1, (4*r+5)*16 + i);
-      v.emplace_back(1, (4*r+6)*16 + i);
-      sys.emplace_back(move(v));
+  for (unsigned i = 0; last && r1 > 0 && i < 16; ++i) {
+    sys.add(1, var(r1-1, 3, i));
+    sys.add(1, var(r1, 0, cipher.shiftRows[i]));
+    sys.close();
+  }
+  // key schedule of AES on Nk = keyWords words: the word w (column w%4 of K_{w/4}) is the word w-Nk plus
+  // SubWord(RotWord(w-1)) if w%Nk == 0, SubWord(w-1) if Nk > 6 and w%Nk == 4 and the word w-1 otherwise
+  unsigned const Nk = cipher.keyWords;
+  auto const key = [&var](unsigned w, unsigned row) {return var(w/4, 1, 4*row + w%4);};
+  for (unsigned w = max(Nk, 4*r0); w < 4*((last && cipher.lastRoundKey) ? r1+1 : r1); ++w) {
+    for (unsigned row = 0; row < 4; ++row) {
+      sys.add(1, key(w, row));
+      sys.add(1, key(w-Nk, row));
+      if (w%Nk == 0) sys.add(1, -key(w-1, (row+1)%4));
+      else if (Nk > 6 && w%Nk == 4) sys.add(1, -key(w-1, row));
+      else sys.add(1, key(w-1, row));
+      sys.close();
     }
   }
-  for (unsigned r = 2; r <= R; ++r) {
-    for (unsigned i = 0; i < 4; ++i) {
-      for (unsigned j = 1; j < 4; ++j) {
-        // K_{r}[i] = K_r[i-4] + K_{r-2}[i]
-        vector<pair<GFElement, int>> v;
-        v.emplace_back(1, (4*r+1)*16 + 4*i + j);
-        v.emplace_back(1, (4*r+1)*16 + 4*i + j - 1);
-        v.emplace_back(1, (4*r-7)*16 + 4*i + j);
-        sys.emplace_back(move(v));
-      }
+  return sys;
+}
 
-      unsigned j = 4*((r%2 == 0) ? (i+1)%4 : i) + 3;
-      // K_{r}[i] = S(K_{r-1}[j]) + K_{r-2}[i]
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, -((4*r-3)*16 + j));
-      v.emplace_back(1, (4*r+1)*16 + 4*i);
-      v.emplace_back(1, (4*r-7)*16 + 4*i);
-      sys.emplace_back(move(v));
+template <unsigned int Poly>
+typename MatrixT<Poly>::Equations AES128sys(unsigned R) {return equations<Poly>(AES128cipher, 0, R, true);}
+template <unsigned int Poly>
+typename MatrixT<Poly>::Equations AES192sys(unsigned R) {return equations<Poly>(AES192cipher, 0, R, true);}
+template <unsigned int Poly>
+typename MatrixT<Poly>::Equations AES256sys(unsigned R) {return equations<Poly>(AES256cipher, 0, R, true);}
 
+template <unsigned int Poly>
+MatrixT<Poly> AES192eqs(unsigned R, vector<int> const & pivots) {return MatrixT<Poly>(AES192sys<Poly>(R), pivots);}
+template <unsigned int Poly>
+MatrixT<Poly> AES256eqs(unsigned R, vector<int> const & pivots) {return MatrixT<Poly>(AES256sys<Poly>(R), pivots);}
+template <unsigned int Poly>
+MatrixT<Poly> AES128eqs(unsigned R, vector<int> const & pivots) {return MatrixT<Poly>(AES128sys<Poly>(R), pivots);}
+
+// the Z and Y variables and the last round of X and K, in the order they are pivoted out
+static vector<int> searchPivots(unsigned R) {
+  vector<int> pivots;
+  for (unsigned r = 0; r <= 4*R+2; ++r) {
+    for (unsigned i = 0; i < 16; ++i) {
+      if ((r%4 == 2 && r < 4*R+2) || (r%4 == 1 && r < 4*R+1)) continue;
+      pivots.emplace_back(16*r + i);
     }
   }
-  return Matrix(sys);
+  return pivots;
 }
 
-// system of equations of AES-128
-Matrix AES128eqs(unsigned R) {
-  GFElement mc [4] = {2, 3, 1, 1};
-  vector<unsigned> shiftRows ({0, 1, 2, 3, 7, 4, 5, 6, 10, 11, 8, 9, 13, 14, 15, 12});
-  vector<unsigned> shiftRowsInv (16);
-  for (unsigned i = 0; i < 16; ++i) shiftRowsInv[shiftRows[i]] = i;
+template <unsigned int Poly>
+static MatrixT<Poly> pivotOut(MatrixT<Poly> & mat, vector<int> const & pivots) {
+  unsigned pivot = 0;
+  for (auto x : pivots) {
+    if (mat.setAsPivot(x, pivot)) ++pivot;
+  }
+  auto res = mat.extract(pivot);
+  res.sparsify();
+  return res;
+}
 
-  vector<vector<pair<GFElement, int>>> sys;
-  // P + K0 = X0
-  for (unsigned i = 0; i < 16; ++i) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, i);
-    v.emplace_back(1, i+16);
-    v.emplace_back(1, i+32);
-    sys.emplace_back(move(v));
-  }
-  for (unsigned r = 0; r < R; ++r) {
-    for (unsigned i = 0; i < 16; ++i) {
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, (4*r+3)*16 + i);
-      v.emplace_back(1, -((4*r+2)*16 + i));
-      sys.emplace_back(move(v));
-    }
-  }
-  for (unsigned r = 0; r < R-1; ++r) {
-    for (unsigned c = 0; c < 4; ++c) {
-      for (unsigned i = 0; i < 4; ++i) {
-        vector<pair<GFElement, int>> v;
-        for (unsigned j = 0; j < 4; ++j) v.emplace_back(mc[(j + 4 - i)%4], (4*r+3)*16 + shiftRowsInv[4*j + c]);
-        v.emplace_back(1, (4*r+4)*16 + 4*i + c);
-        sys.emplace_back(move(v));
-      }
-    }
-  }
-  for (unsigned i = 0; i < 16; ++i) {
-    vector<pair<GFElement, int>> v;
-    v.emplace_back(1, (4*R-1)*16 + i);
-    v.emplace_back(1, (4*R)*16 + shiftRows[i]);
-    sys.emplace_back(move(v));
-  }
-  for (unsigned r = 0; r < R-1; ++r) {
-    for (unsigned i = 0; i < 16; ++i) {
-      vector<pair<GFElement, int>> v;
-      v.emplace_back(1, (4*r+4)*16 + i);
-      v.emplace_back(1, (4*r+5)*16 + i);
-      v.emplace_back(1, (4*r+6)*16 + i);
-      sys.emplace_back(move(v));
-    }
-  }
-    // Key schedule relations
-  for (unsigned r = 1; r <= R; ++r) {
-      for (unsigned i = 0; i < 16; ++i) {
-        if (i%4 == 0) {
-            vector<pair<GFElement, int>> v;
-            v.emplace_back(1, 16*(4*r +1) + i);
-            v.emplace_back(1, 16*(4*(r-1) +1) + i);
-            v.emplace_back(1, -(16*(4*(r-1) + 1)  + (i+7)%16));
-            sys.emplace_back(move(v));
-        }
-        else{
-            vector<pair<GFElement, int>> v;
-            v.emplace_back(1, 16*(4*r +1) + i);
-            v.emplace_back(1, 16*(4*(r-1) +1) + i);
-            v.emplace_back(1, 16*(4*r +1) + i-1);
-            sys.emplace_back(move(v));
-        }
-      }
-                           }
-    return Matrix(sys);
+template <unsigned int Poly>
+MatrixT<Poly> searchSystem(MatrixT<Poly> (*eqs)(unsigned, vector<int> const &), unsigned R) {
+  auto const pivots = searchPivots(R);
+  auto mat = eqs(R, pivots);
+  return pivotOut(mat, pivots);
 }
+
+template <unsigned int Poly>
+MatrixT<Poly> SearchSystemsT<Poly>::operator()(unsigned R) {
+  if (R < rounds) *this = SearchSystemsT(*cipher);
+  auto const pivots = searchPivots(R);
+  for (; rounds < R; ++rounds) mat.appendLines(equations<Poly>(*cipher, rounds, rounds+1, false), pivots);
+  auto res = mat;
+  res.appendLines(equations<Poly>(*cipher, R, R, true), pivots);
+  return pivotOut(res, pivots);
+}
+
+
+// The fields of GFieldDispatch
+template MatrixT<0x02>::Equations equations<0x02>(Cipher const &, unsigned, unsigned, bool);
+template MatrixT<0x02> AES192eqs<0x02>(unsigned, vector<int> const &);
+template MatrixT<0x02> AES256eqs<0x02>(unsigned, vector<int> const &);
+template MatrixT<0x02> AES128eqs<0x02>(unsigned, vector<int> const &);
+template MatrixT<0x02> searchSystem<0x02>(MatrixT<0x02> (*)(unsigned, vector<int> const &), unsigned);
+template class SearchSystemsT<0x02>;
+
+template MatrixT<0x13>::Equations equations<0x13>(Cipher const &, unsigned, unsigned, bool);
+template MatrixT<0x13> AES192eqs<0x13>(unsigned, vector<int> const &);
+template MatrixT<0x13> AES256eqs<0x13>(unsigned, vector<int> const &);
+template MatrixT<0x13> AES128eqs<0x13>(unsigned, vector<int> const &);
+template MatrixT<0x13> searchSystem<0x13>(MatrixT<0x13> (*)(unsigned, vector<int> const &), unsigned);
+template class SearchSystemsT<0x13>;
+
+template MatrixT<0x11b>::Equations equations<0x11b>(Cipher const &, unsigned, unsigned, bool);
+template MatrixT<0x11b> AES192eqs<0x11b>(unsigned, vector<int> const &);
+template MatrixT<0x11b> AES256eqs<0x11b>(unsigned, vector<int> const &);
+template MatrixT<0x11b> AES128eqs<0x11b>(unsigned, vector<int> const &);
+template MatrixT<0x11b> searchSystem<0x11b>(MatrixT<0x11b> (*)(unsigned, vector<int> const &), unsigned);
+template class SearchSystemsT<0x11b>;
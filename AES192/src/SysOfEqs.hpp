@@ -4,9 +4,75 @@
 #include "Matrix.hpp"
 
 
-Matrix AES192eqs(unsigned R);
-Matrix AES256eqs(unsigned R);
-Matrix AES128eqs(unsigned R);
+typedef Matrix::Equations Equations;
+
+// AES-like cipher on 4x4 cells: the round is SubBytes, ShiftRows (the cell i goes to shiftRows[i]), MixColumns
+// (mixColumns[4*i + j] is the coefficient of row j in row i, there is no MixColumns in the last round) and the key
+// addition. The round keys are expanded by the key schedule of AES on keyWords words. The models differ on the end:
+// with lastKeyAddition the last round key is added, with lastRoundKey it is tied to the previous ones by the key schedule.
+// The coefficients of MixColumns are read in the field of the systems.
+struct Cipher {
+  std::array<unsigned, 16> shiftRows;
+  std::array<GFSymbol, 16> mixColumns;
+  unsigned keyWords;
+  bool lastKeyAddition;
+  bool lastRoundKey;
+};
+
+extern Cipher const AES128cipher;
+extern Cipher const AES192cipher;
+extern Cipher const AES256cipher;
+
+// polynomial of the field of the systems of a run, picked once at startup and handed to GFieldDispatch:
+// $AESCM_FIELD (e.g. AESCM_FIELD=0x13), GF_POLY of the build if it is not set (the AES field 0x11b by default)
+unsigned fieldOfRun();
+
+// The systems are built over the field Poly, one of GFieldDispatch. The functions below throw std::invalid_argument
+// if a coefficient of MixColumns is not an element of it.
+
+// equations of the rounds r0..r1-1 of cipher (key addition, S-boxes, the MixColumns into the round and its round key),
+// with last those ending the cipher after the round r1-1 (ShiftRows without MixColumns, the last key addition and
+// the last round key), generated in one Equations array
+template <unsigned int Poly>
+typename MatrixT<Poly>::Equations equations(Cipher const & cipher, unsigned r0, unsigned r1, bool last);
+
+// equations of cipher on R rounds
+template <unsigned int Poly = 0x11b>
+typename MatrixT<Poly>::Equations equations(Cipher const & cipher, unsigned R) {return equations<Poly>(cipher, 0, R, true);}
+
+// equations of AES on R rounds
+template <unsigned int Poly = 0x11b> typename MatrixT<Poly>::Equations AES192sys(unsigned R);
+template <unsigned int Poly = 0x11b> typename MatrixT<Poly>::Equations AES256sys(unsigned R);
+template <unsigned int Poly = 0x11b> typename MatrixT<Poly>::Equations AES128sys(unsigned R);
+
+// systems of equations of AES on R rounds, eliminated with the variables of pivots as first fronts (see Matrix)
+template <unsigned int Poly = 0x11b> MatrixT<Poly> AES192eqs(unsigned R, std::vector<int> const & pivots = {});
+template <unsigned int Poly = 0x11b> MatrixT<Poly> AES256eqs(unsigned R, std::vector<int> const & pivots = {});
+template <unsigned int Poly = 0x11b> MatrixT<Poly> AES128eqs(unsigned R, std::vector<int> const & pivots = {});
+
+// system of the search on R rounds: the Z and Y variables and the last round of X and K are pivoted
+// out of the equations eqs(R) (AESxxxeqs) and the lines left are extracted, then sparsified
+template <unsigned int Poly>
+MatrixT<Poly> searchSystem(MatrixT<Poly> (*eqs)(unsigned, std::vector<int> const &), unsigned R);
+
+// Search systems of a sweep over R (as searchSystem, from the equations of cipher): the equations of the rounds
+// 0..R-1 are kept eliminated and extended by the equations of one round at each step (Matrix::appendLines), so that
+// the system of R rounds only appends the equations ending the cipher to a copy of them. The sweep restarts if R
+// decreases.
+template <unsigned int Poly>
+class SearchSystemsT
+{
+public:
+  explicit SearchSystemsT(Cipher const & cipher) : cipher (&cipher) {};
+  MatrixT<Poly> operator()(unsigned R);
+
+private:
+  Cipher const * cipher;
+  unsigned rounds = 0;
+  MatrixT<Poly> mat; // eliminated equations of the rounds 0..rounds-1
+};
+
+typedef SearchSystemsT<0x11b> SearchSystems;
 
 #endif
 
@@ -0,0 +1,184 @@
+// Packed rows against rows of one coefficient per byte: random systems are eliminated and searched with both layouts
+// of a field, which must give the same matrices and the same answers, and the packed rows must be smaller and faster
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+
+#include "Matrix.hpp"
+
+using namespace std;
+
+static unsigned failures = 0;
+
+static void check(bool ok, string const & what) {
+  if (ok) return;
+  ++failures;
+  cerr << "FAILED: " << what << endl;
+}
+
+template <unsigned int Poly, unsigned int D1, unsigned int D2>
+static bool same(MatrixT<Poly, D1> const & a, MatrixT<Poly, D2> const & b) {
+  if (a.nblines != b.nblines || a.nbcols != b.nbcols || a.weight() != b.weight()) return false;
+  for (unsigned l = 0; l < a.nblines; ++l) {
+    if (a.getFront(l) != b.getFront(l)) return false;
+    vector<uint16_t> const sa (a.nonzeros(l).begin(), a.nonzeros(l).end()), sb (b.nonzeros(l).begin(), b.nonzeros(l).end());
+    if (sa != sb) return false;
+    for (unsigned c = 0; c < a.nbcols; ++c) {
+      if (a(l, c) != b(l, c)) return false;
+    }
+  }
+  for (unsigned c = 0; c < a.nbcols; ++c) {
+    if (a.getColumns(c) != b.getColumns(c)) return false;
+  }
+  return true;
+}
+
+// runs the same random systems and operations on the packed layout of the field Poly and on the bytes
+template <unsigned int Poly>
+static void compareLayouts(string const & field, unsigned systems) {
+  typedef MatrixT<Poly> Packed;
+  typedef MatrixT<Poly, 8> Bytes;
+  typedef typename Packed::GFElement GFElement;
+  unsigned const card = 1u << GFieldDim(Poly);
+  mt19937 rng (Poly);
+  auto const coef = [&]() {return GFElement(GFSymbol(1 + rng()%(card - 1)));};
+
+  for (unsigned t = 0; t < systems; ++t) {
+    string const where = field + " system " + to_string(t);
+    // up to 200 variables: the packed rows span several words
+    unsigned const nvars = 20 + rng()%180;
+    auto const var = [&]() {return int(1 + rng()%nvars);};
+    // the same random equations for both layouts (their Equations are distinct types)
+    auto const randomSystem = [&](unsigned n) {
+      pair<typename Packed::Equations, typename Bytes::Equations> sys;
+      for (unsigned e = 0; e < n; ++e) {
+        unsigned const terms = 2 + rng()%5;
+        for (unsigned k = 0; k < terms; ++k) {
+          auto const c = coef(); auto const v = ((rng()%4 == 0) ? -1 : 1)*var();
+          sys.first.add(c, v); sys.second.add(c, v);
+        }
+        sys.first.close(); sys.second.close();
+      }
+      return sys;
+    };
+    vector<int> pivots;
+    for (unsigned k = rng()%8; k > 0; --k) pivots.emplace_back(var());
+
+    auto const sys = randomSystem(nvars/2 + rng()%(nvars/2));
+    Packed a (sys.first, pivots);
+    Bytes b (sys.second, pivots);
+    check(same(a, b), where + ": elimination");
+    auto const more = randomSystem(1 + rng()%8);
+    a.appendLines(more.first, pivots);
+    b.appendLines(more.second, pivots);
+    check(same(a, b), where + ": appendLines");
+    check(a.sparsify() == b.sparsify() && same(a, b), where + ": sparsify");
+
+    // steps of a search: pivots and exchanges under nested checkpoints, undone in turn
+    vector<unsigned> marks;
+    for (unsigned step = 0; step < 40 && a.nblines > 0; ++step) {
+      auto const s = where + ": step " + to_string(step);
+      switch (rng()%6) {
+        case 0: marks.emplace_back(a.checkpoint()); b.checkpoint(); break;
+        case 1:
+          if (!marks.empty()) {
+            a.rewind(marks.back());
+            b.rewind(marks.back());
+            marks.pop_back();
+            check(same(a, b), s + " rewind");
+          }
+          break;
+        case 2: {
+          int const x = ((rng()%2 == 0) ? -1 : 1)*var();
+          unsigned const start = rng()%a.nblines, end = start + rng()%(a.nblines - start + 1);
+          check(a.setAsPivot(x, start, end) == b.setAsPivot(x, start, end) && same(a, b), s + " setAsPivot");
+          break;
+        }
+        case 3: {
+          unsigned const l = rng()%a.nblines;
+          auto const nz = a.nonzeros(l);
+          if (nz.size() == 0) break;
+          unsigned const c = nz.begin()[rng()%nz.size()];
+          a.swapLineColumn(l, c);
+          b.swapLineColumn(l, c);
+          check(same(a, b), s + " swapLineColumn");
+          break;
+        }
+        case 4: {
+          // consistency tests of the search: a line null on the columns of mask
+          vector<uint64_t> mask ((a.nbcols + 63)/64, 0);
+          for (auto & w : mask) w = (uint64_t(rng()) << 32 | rng()) & (uint64_t(rng()) << 32 | rng());
+          for (unsigned l = 0; l < a.nblines; ++l) check(a.isZeroOn(l, mask) == b.isZeroOn(l, mask), s + " isZeroOn");
+          break;
+        }
+        case 5: {
+          unsigned const l1 = rng()%a.nblines, l2 = rng()%a.nblines;
+          a.swapLines(l1, l2);
+          b.swapLines(l1, l2);
+          check(same(a, b), s + " swapLines");
+          break;
+        }
+      }
+    }
+    while (!marks.empty()) {
+      a.rewind(marks.back());
+      b.rewind(marks.back());
+      marks.pop_back();
+    }
+    check(same(a, b), where + ": rewound");
+    unsigned const l = rng()%(a.nblines + 1);
+    check(same(a.extract(l), b.extract(l)), where + ": extract");
+  }
+}
+
+// a packed row takes Dim/8 of the bytes of a row of bytes; its row operations (axpy) are timed against them, the
+// best of a few runs each, and must be faster at least by factor
+template <unsigned int Poly>
+static void compareCosts(string const & field, double factor) {
+  typedef typename MatrixT<Poly>::Row Packed;
+  typedef typename MatrixT<Poly, 8>::Row Bytes;
+  unsigned const n = 4096, dim = GFieldDim(Poly);
+  check(8*Packed::nbWords(n)*sizeof(typename Packed::Word) == dim*Bytes::nbWords(n)*sizeof(typename Bytes::Word),
+    field + ": size of the packed rows");
+
+  mt19937 rng (Poly);
+  vector<GFSymbol> coefs (n);
+  for (auto & c : coefs) c = GFSymbol(rng()%(1u << dim));
+  auto const time = [&](auto row) {
+    typedef decltype(row) Row;
+    // 8 rows, each added to the next one
+    unsigned const w = Row::nbWords(n);
+    vector<typename Row::Word> rows (8*w);
+    for (unsigned i = 0; i < 8; ++i) {
+      for (unsigned j = 0; j < n; ++j) Row::set(rows.data() + i*w, j, coefs[(j + 97*i)%n]);
+    }
+    double best = 1e9;
+    for (unsigned run = 0; run < 5; ++run) {
+      auto const start = chrono::steady_clock::now();
+      for (unsigned k = 0; k < 20000; ++k) {
+        Row::axpy(rows.data() + ((k+1)%8)*w, rows.data() + (k%8)*w, GFSymbol(1 + k%((1u << dim) - 1)), n);
+      }
+      best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    GFSymbol any = 0;
+    for (unsigned i = 0; i < 8; ++i) any |= Row::get(rows.data() + i*w, n-1);
+    volatile GFSymbol sink = any; (void)sink;
+    return best;
+  };
+  double const packed = time(Packed()), bytes = time(Bytes());
+  cout << field << ": packed rows of " << n << " coefficients take " << Packed::nbWords(n)*sizeof(typename Packed::Word)
+       << " bytes (" << Bytes::nbWords(n)*sizeof(typename Bytes::Word) << "), axpy " << bytes/packed << " times faster" << endl;
+  check(bytes >= factor*packed, field + ": throughput of the packed rows");
+}
+
+int main() {
+  compareLayouts<0x02>("F_2", 200);
+  compareLayouts<0x13>("GF(16)", 200);
+  compareCosts<0x02>("F_2", 2);
+  compareCosts<0x13>("GF(16)", 1.3);
+  if (failures != 0) cerr << failures << " checks failed" << endl;
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#ifndef DEF_LAYOUT
+#define DEF_LAYOUT
+
+#include <array>
+#include <cstdint>
+
+// Mixed-radix counter over N base-5 digits: index = sum digit[i]*strides[i], the digit 0 varying fastest.
+// next() moves to the following digits with additions only, and returns false once all of them were visited
+template <unsigned N>
+class RadixCounter
+{
+public:
+  explicit RadixCounter(std::array<unsigned, N> const & strides) : strides(strides), digits{}, index(0) {};
+
+  unsigned operator*() const {return index;};
+
+  bool next() {
+    for (unsigned i = 0; i < N; ++i) {
+      if (++digits[i] < 5) {index += strides[i]; return true;}
+      digits[i] = 0;
+      index -= 4*strides[i];
+    }
+    return false;
+  };
+
+private:
+  std::array<unsigned, N> strides;
+  std::array<unsigned, N> digits;
+  unsigned index;
+};
+
+// Permutations of the 5^4 states (4 base-5 digits) putting the digit col on top: order[125*x + i] is the i-th
+// state whose digit col is x, so that a pass on the column col sees the states with a given digit as a slice of
+// 125 consecutive cells. The digit 3 is already on top, the permutation of col = 3 is the identity
+inline std::array<uint16_t, 5*5*5*5> const & topDigitOrder(unsigned col) {
+  static auto const orders = []() {
+    std::array<std::array<uint16_t, 5*5*5*5>, 4> res;
+    for (unsigned c = 0; c < 4; ++c) {
+      std::array<unsigned, 4> strides;
+      for (unsigned i = 0, s = 1; i < 4; ++i, s *= 5) strides[(i < c) ? i : (i == c) ? 3 : i-1] = s;
+      RadixCounter<4> it (strides);
+      unsigned p = 0;
+      do res[c][p++] = *it; while (it.next());
+    }
+    return res;
+  }();
+  return orders[col];
+}
+
+// row in the order: dst[p] = src[order[p]]
+inline void gatherStates(uint8_t * dst, uint8_t const * src, std::array<uint16_t, 5*5*5*5> const & order) {
+  for (unsigned p = 0; p < order.size(); ++p) dst[p] = src[order[p]];
+}
+
+// back to the states: dst[order[p]] = src[p]
+inline void scatterStates(uint8_t * dst, uint8_t const * src, std::array<uint16_t, 5*5*5*5> const & order) {
+  for (unsigned p = 0; p < order.size(); ++p) dst[order[p]] = src[p];
+}
+
+#endif
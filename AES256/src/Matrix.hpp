@@ -2,61 +2,175 @@
 #define DEF_MATRIX
 
 #include <vector>
+#include <array>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <functional>
 
 #include "GFElement.hpp"
+#include "GFRow.hpp"
 
 
-class Matrix
+// Dim selects the layout of the rows (GFRow): by default they are packed for F_2 and GF(2^4), Dim = 8 stores one
+// coefficient per GFSymbol in any field
+template <unsigned int Poly, unsigned int Dim = GFieldDim(Poly)>
+class MatrixT
 {
 public:
-  Matrix() = default;
-  Matrix(std::vector<std::vector<std::pair<GFElement, int>>> const &);
-  Matrix(Matrix const & m) : nbcols (m.nbcols), nblines (m.nblines), front(m.front), columns(m.columns), space(m.space) {
-    lines.reserve(nblines);
-    for (unsigned l = 0; l < nblines; ++l) lines.emplace_back(&space[0] + (m.lines[l]- &m.space[0]));
+  typedef GFElementT<Poly> GFElement;
+  typedef GFRow<Poly, Dim> Row; // layout of the rows, packed for small fields
+
+  // Equations in one array: equation i is terms[ends[i-1] .. ends[i]) (ends[-1] = 0), its terms are added by add
+  // and it is ended by close
+  struct Equations {
+    typedef std::pair<GFElement, int> Term;
+    struct Equation {
+      Term const * first;
+      Term const * last;
+      Term const * begin() const {return first;};
+      Term const * end() const {return last;};
+      unsigned size() const {return last - first;};
+    };
+    struct Iterator {
+      Equations const * sys;
+      unsigned i;
+      Equation operator*() const {return (*sys)[i];};
+      Iterator & operator++() {++i; return *this;};
+      bool operator!=(Iterator const & it) const {return i != it.i;};
+    };
+
+    std::vector<Term> terms;
+    std::vector<unsigned> ends;
+
+    unsigned size() const {return ends.size();};
+    Equation operator[](unsigned i) const {return Equation {terms.data() + (i == 0 ? 0 : ends[i-1]), terms.data() + ends[i]};};
+    Iterator begin() const {return Iterator {this, 0};};
+    Iterator end() const {return Iterator {this, size()};};
+
+    void add(GFElement const & coef, int x) {terms.emplace_back(coef, x);};
+    void close() {ends.push_back(terms.size());};
+    void append(Equation const & eq) {terms.insert(terms.end(), eq.begin(), eq.end()); close();};
+  };
+
+  MatrixT() = default;
+  // Eliminates the system sys, the fronts are chosen in Markowitz order (fewest fill-in first) and the variables
+  // of pivots are made fronts before the others whenever they can be
+  MatrixT(Equations const & sys, std::vector<int> const & pivots = {});
+  MatrixT(MatrixT const & m) : nbcols (m.nbcols), nblines (m.nblines), maxvar(m.maxvar), nzcap(m.nzcap), stride(m.stride), lastepoch(m.lastepoch) {
+    clone(m);
   };
-  Matrix(Matrix &&) = default;
+  MatrixT(MatrixT && m) : MatrixT() {swapStorage(m);};
+  ~MatrixT() {release();};
 
-  Matrix & operator=(Matrix const & m) {
+  MatrixT & operator=(MatrixT const & m) {
+      if (this == &m) return *this;
       nbcols = m.nbcols;
       nblines = m.nblines;
-      front = m.front;
-      columns = m.columns;
-      space = m.space;
-      lines = std::vector<GFElement*> ();
-      lines.reserve(nblines);
-      for (unsigned l = 0; l < nblines; ++l) lines.emplace_back(&space[0] + (m.lines[l]- &m.space[0]));
+      maxvar = m.maxvar;
+      nzcap = m.nzcap;
+      stride = m.stride;
+      lastepoch = m.lastepoch;
+      clone(m);
+      trail.clear();
       return *this;
   };
 
-  Matrix & operator=(Matrix &&) = default;
+  MatrixT & operator=(MatrixT && m) {swapStorage(m); return *this;};
 
   unsigned checkZ(double * X);
   std::vector<int> checkK(double * X, double * SK, std::map<unsigned, unsigned> const & mapSK);
   std::vector<int> checkZ2(double * X, unsigned nX, std::set<unsigned> const & setSK);
 
-  unsigned checkZ(unsigned line1, std::vector<std::vector<uint8_t>> const & valX, std::vector<std::vector<uint8_t>> const & valK);
+  // last line before line1 with no nonzero coefficient on a variable of value 1 (see setValue), line1 if there is none
+  unsigned checkZ(unsigned line1) const;
+
+  // dimension (0, 1 or 2) of the span of the coefficients of x1 and x2 on the lines start..
+  unsigned dim2(int x1, int x2, unsigned start = 0) const;
+  bool appears(int x, unsigned start) const {return dim2(x, x, start) != 0;};
+
+  // sets the variables of vars, in this order, as pivots of the lines start.. when they do not depend on the previous
+  // ones (setAsPivot on each of them), returns the line after the last pivot
+  unsigned echelonizeOn(std::vector<int> const & vars, unsigned start = 0);
+
+  // pivots the pairs (x, -x) of vars on the lines start.. until the x left are nonlinear (x and -x are independent):
+  // x is pivoted when -x depends on it and -x is pivoted when x does not appear, both are removed from vars.
+  // Returns the line after the last pivot.
+  unsigned echelonizeOnPairs(std::vector<int> & vars, unsigned start);
+
+  MatrixT extract(unsigned) const;
+
+  // Appends the equations of sys to the system (outside of a search, no checkpoint open): they are reduced on the
+  // lines and only they are eliminated, as in the constructor, the lines are then reduced on the new fronts
+  void appendLines(Equations const & sys, std::vector<int> const & pivots = {});
 
-  bool dim2(int x1, int x2) const;
+  // Solutions of the lines (front = sum of the coefficients times the columns) with the variables of zeros set to 0:
+  // a basis of this space, each vector giving the values of vars, the fronts and then the columns
+  struct Solutions {
+    std::vector<int> vars;
+    std::vector<std::vector<GFElement>> basis;
+    unsigned dimension() const {return basis.size();};
+  };
+  Solutions solutions(std::vector<int> const & zeros) const;
+
+  // Calls f on the solutions of space with the variables of nonzeros all nonzero (the S-box transitions are not
+  // checked) until it returns false, and returns the number of these solutions. The solutions are enumerated in
+  // Gray-code order on the basis over GF(2): two consecutive ones differ by one multiple 2^k of a basis vector.
+  // Throws std::invalid_argument if space has 2^64 vectors or more.
+  uint64_t enumerate(Solutions const & space, std::vector<int> const & nonzeros,
+    std::function<bool(std::vector<GFElement> const &)> const & f) const;
+  // Number of these solutions without walking them, saturated at UINT64_MAX: each group of nonzeros linked by the
+  // basis vectors is counted apart, by inclusion-exclusion on its positions or by enumerate on its span, whichever
+  // is smaller. Throws std::invalid_argument if both are beyond reach (2^40 steps).
+  uint64_t count(Solutions const & space, std::vector<int> const & nonzeros) const;
+
+  GFElement operator()(unsigned i, unsigned j) const { return Row::get(line(i), j);};
+  void setCoef(unsigned i, unsigned j, GFElement const & x) {
+    if ((Row::get(line(i), j) == 0) != (x == 0)) support(i)[0] = nzstale;
+    Row::set(line(i), j, x.getValue());
+  };
 
-  void echelonizeOn(std::vector<int> const &);
+  // number of nonzero coefficients of the lines (the fronts are not counted)
+  unsigned weight() const;
 
-  Matrix extract(unsigned) const;
+  // The lines are reduced on their fronts, so they are fixed by the choice of the fronts: exchanges the front of a
+  // line start.. with one of its columns (swapLineColumn) while this lowers the weight, returns the weight removed
+  unsigned sparsify(unsigned start = 0);
 
-  GFElement const & operator()(unsigned i, unsigned j) const { return lines[i][j];};
-  GFElement & operator()(unsigned i, unsigned j) {return lines[i][j];};
+  // columns of the nonzero coefficients of line i, in increasing order (use: for (unsigned c : nonzeros(i)) ...)
+  struct Support {
+    uint16_t const * first;
+    uint16_t const * last;
+    uint16_t const * begin() const {return first;};
+    uint16_t const * end() const {return last;};
+    unsigned size() const {return last - first;};
+  };
+  Support nonzeros(unsigned i) const {
+    auto const s = support(i);
+    if (s[0] == nzstale) resetSupport(i);
+    return Support {s + 1, s + 1 + s[0]};
+  };
+
+  // true if line i has no nonzero coefficient on the columns set in mask (bit j%64 of mask[j/64])
+  bool isZeroOn(unsigned i, std::vector<uint64_t> const & mask) const;
 
   int getFront(unsigned i) const {return front[i];};
   int getColumns(unsigned i) const {return columns[i];};
 
+  // fields of a variable x of the system, |x| = 16*(4*round + kind) + cell with kind 0 (Z), 1 (K), 2 (X) or 3 (Y)
+  // and x < 0 for an S-box output, read from the tables of the matrix (|x| <= maxvar)
+  unsigned kindOf(int x) const {return kinds[abs(x)];};
+  unsigned roundOf(int x) const {return rounds[abs(x)];};
+  unsigned cellOf(int x) const {return cells[abs(x)];};
+
+  // line of variable x if it is a front (nblines otherwise), column of x if it is a column (nbcols otherwise)
+  unsigned lineOf(int x) const {auto const p = positionOf(x); return p < nblines ? p : nblines;};
+  unsigned columnOf(int x) const {auto const p = positionOf(x); return p != nopos && p >= nblines ? p - nblines : nbcols;};
+
   void eraseColumn(unsigned c);
 
   void printLine(unsigned i);
 
-  friend std::ostream& operator<<( std::ostream &flux, Matrix const& mat);
-
   bool setAsPivot(int x, unsigned start);
   bool isLinear(int x, unsigned start);
 
@@ -66,23 +180,149 @@ public:
   bool setAsPivot(int x, unsigned start, unsigned end);
   bool setColumnAsPivot(unsigned c, unsigned start, unsigned end);
 
-  unsigned nbcols;
-  unsigned nblines;
+  // Undo trail: while a checkpoint is open, the changes of the lines, swapLines, swapLineColumn, eraseColumn and setValue
+  // are recorded and rewind(mark) undoes them back to the checkpoint that returned mark (checkpoints are nested)
+  unsigned checkpoint() {trail.epochs.push_back(++lastepoch); return trail.undo.size();};
+  void rewind(unsigned mark);
+
+  // assigns the value v (0, 1 or 2 when unknown) of the search to the variable x (and -x), stored by the search in
+  // cell (valX, valK): the value is restored by rewind and the lines are scanned by value with firstWithValue
+  void setValue(uint8_t & cell, int x, uint8_t v);
+
+  // first column of a nonzero coefficient of line i whose variable has the value v (nbcols if there is none),
+  // and number of these columns
+  unsigned firstWithValue(unsigned i, uint8_t v) const {
+    auto const mask = rowMask(i);
+    auto const vmask = colmasks + v*maskWords();
+    for (unsigned w = 0; w < maskWords(); ++w) {
+      if (auto const b = mask[w] & vmask[w]) return 64*w + __builtin_ctzll(b);
+    }
+    return nbcols;
+  };
+  unsigned countWithValue(unsigned i, uint8_t v) const {
+    auto const mask = rowMask(i);
+    auto const vmask = colmasks + v*maskWords();
+    unsigned n = 0;
+    for (unsigned w = 0; w < maskWords(); ++w) n += __builtin_popcountll(mask[w] & vmask[w]);
+    return n;
+  };
+
+  unsigned nbcols = 0;
+  unsigned nblines = 0;
 
 private:
-  std::vector<int> front;
-  std::vector<int> columns;
+  // The whole state is in one block (see offsets) so that a copy is a single memcpy, the pointers below are
+  // rebased on the block after each copy. Line l is stored in slot slot[l] of space and supspace.
+  std::vector<uint64_t> block;
+
+  int * front = nullptr;
+  int * columns = nullptr; // nzcap entries, the nbcols first ones are used
+
+  // position[x + maxvar] is l if front[l] == x, nblines + c if columns[c] == x and nopos if x is not in the system
+  static constexpr uint16_t nopos = 0xffff;
 
-  std::vector<GFElement> space;
-  std::vector<GFElement*> lines;
+  int maxvar = 0;
+  uint16_t * position = nullptr;
 
+  unsigned positionOf(int x) const {return (x < -maxvar || x > maxvar) ? nopos : position[x + maxvar];};
 
+  // Rows are dense for the row operations and sparse for the scans: support(l)[0] is the number
+  // of nonzero coefficients of line l and support(l)[1..] their sorted columns. The row operations
+  // only mark the support nzstale, it is rebuilt by the next scan of the line.
+  static constexpr uint16_t nzstale = 0xffff;
 
+  unsigned nzcap = 0;
+  unsigned stride = 0; // words of a row in space
+  typename Row::Word * space = nullptr;
+  uint16_t * supspace = nullptr;
+  uint16_t * slot = nullptr;
 
+  typename Row::Word * line(unsigned l) const {return space + slot[l]*stride;};
+  uint16_t * support(unsigned l) const {return supspace + slot[l]*(nzcap+1);};
 
+  void resetSupport(unsigned i) const;
 
+  // The values of the search are kept as bitsets over the columns so that a line is scanned by value with a few
+  // word ands: rowmasks holds, for each slot, the columns of the support of its line (rebuilt with the support)
+  // and colmasks[v*maskWords()..] the columns whose variable has the value v (values[|x|], 2 until setValue).
+  // kindmasks[k*maskWords()..] are the columns whose variable is of kind k, both are updated by resetColumn.
+  uint64_t * rowmasks = nullptr;
+  uint64_t * colmasks = nullptr;
+  uint64_t * kindmasks = nullptr;
+  uint8_t * values = nullptr;
 
+  // fields of the variables (kindOf, roundOf, cellOf), indexed by |x|
+  uint8_t * kinds = nullptr;
+  uint8_t * cells = nullptr;
+  uint16_t * rounds = nullptr;
 
+  void resetVariables();
+
+  static unsigned eliminate(std::vector<GFElement> & mat, unsigned n, std::vector<int> & v, std::vector<uint8_t> & rank, unsigned first);
+  void assign(std::vector<GFElement> const & mat, unsigned n, std::vector<int> const & v);
+
+  unsigned maskWords() const {return (nzcap + 63)/64;};
+  uint64_t const * rowMask(unsigned l) const {
+    if (support(l)[0] == nzstale) resetSupport(l);
+    return rowmasks + slot[l]*maskWords();
+  };
+  void resetMask(unsigned s) const;
+  void resetColumn(unsigned c);
+
+  struct Undo {
+    enum : uint8_t {Line, SwapLines, SwapLineColumn, EraseColumn, Value} op;
+    uint8_t value; // previous value of the cell and of the variable (Value)
+    uint16_t i, j; // storage slot of the line (Line), lines (SwapLines), line and column (SwapLineColumn), column (EraseColumn)
+    unsigned n; // number of lines saved in erased (EraseColumn)
+    int var; // erased variable (EraseColumn), assigned variable (Value)
+    uint8_t * cell; // assigned cell (Value)
+  };
+
+  // A line is saved (row and support) the first time it changes after a checkpoint: each checkpoint opens a new epoch
+  // and lineepoch[s] is the last epoch in which the line stored in slot s was saved.
+  unsigned lastepoch = 0;
+  unsigned * lineepoch = nullptr;
+
+  struct Trail {
+    std::vector<unsigned> epochs;
+    std::vector<Undo> undo;
+    std::vector<typename Row::Word> rows;
+    std::vector<uint16_t> supports; // each saved support followed by its length
+    std::vector<std::pair<uint16_t, GFSymbol>> erased; // lines modified by eraseColumn and their coefficient on the erased column
+    void clear() {epochs.clear(); undo.clear(); rows.clear(); supports.clear(); erased.clear();};
+  };
+  Trail trail;
+
+  void saveLine(unsigned l);
+  void restoreLine(unsigned s);
+  void restoreColumn(unsigned c, int var, unsigned n);
+
+  // Blocks and trails of the matrices destroyed by a thread, reused by its next copies so that
+  // the copies of the parallel search do not contend on the global allocator
+  struct Arena {
+    std::vector<std::vector<uint64_t>> blocks;
+    std::vector<Trail> trails;
+  };
+  static Arena & arena();
+
+  std::array<std::size_t, 12> offsets() const;
+  void rebase();
+  void clone(MatrixT const & m);
+  void release();
+  void swapStorage(MatrixT & m);
 };
 
+template <unsigned int Poly, unsigned int Dim>
+std::ostream& operator<<( std::ostream &flux, MatrixT<Poly, Dim> const& mat);
+
+// MatrixT is compiled in Matrix.cpp for the fields of GFieldDispatch
+extern template class MatrixT<0x02>;
+extern template class MatrixT<0x13>;
+extern template class MatrixT<0x11b>;
+extern template class MatrixT<0x02, 8>;
+extern template class MatrixT<0x13, 8>;
+
+// Matrices over the AES field, the one of the AES systems of equations
+typedef MatrixT<0x11b> Matrix;
+
 #endif
@@ -0,0 +1,141 @@
+#include "StageStore.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// first line of the manifests, to change with the layout of the stages so that the stores of older builds are
+// computed again instead of being mapped
+static string const formatTag = "aesCM-dp 2";
+
+// FNV-1a on the 64-bit words of a stage (then on its last bytes), written in the manifest and checked on load
+static uint64_t checksum(uint8_t const * data, size_t n) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, data + i, 8);
+    h = (h ^ w)*0x100000001b3ull;
+  }
+  for (; i < n; ++i) h = (h ^ data[i])*0x100000001b3ull;
+  return h;
+}
+
+Stage & Stage::operator=(Stage && other) noexcept {
+  if (this == &other) return *this;
+  unmap();
+  table = move(other.table); // the buffer moves with the vector, first stays valid
+  mapping = other.mapping;
+  first = other.first;
+  n = other.n;
+  other.mapping = nullptr;
+  other.first = nullptr;
+  other.n = 0;
+  return *this;
+}
+
+void Stage::unmap() {
+  if (mapping != nullptr) munmap(mapping, n);
+  mapping = nullptr;
+}
+
+Stage Stage::map(string const & path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw runtime_error("Stage: cannot open " + path);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {close(fd); throw runtime_error("Stage: cannot stat " + path);}
+
+  Stage res;
+  if (st.st_size > 0) {
+    void * m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {close(fd); throw runtime_error("Stage: cannot map " + path);}
+    res.mapping = m;
+    res.first = static_cast<uint8_t const *>(m);
+    res.n = st.st_size;
+  }
+  close(fd);
+  return res;
+}
+
+// writes path aside, in a file of a unique name created in its directory (mkstemp, as the process ids of hosts
+// sharing the directory may be the same), and renames it, so that path is either absent or complete
+static void writeFile(string const & path, char const * data, size_t n) {
+  string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0) throw runtime_error("StageStore: cannot create a file beside " + path + ": " + strerror(errno));
+  int err = (fchmod(fd, 0644) != 0) ? errno : 0; // mkstemp gives 0600, the store is shared
+  for (size_t done = 0; err == 0 && done < n;) {
+    ssize_t const k = write(fd, data + done, n - done);
+    if (k >= 0) done += k;
+    else if (errno != EINTR) err = errno;
+  }
+  if (close(fd) != 0 && err == 0) err = errno;
+  if (err == 0 && rename(tmp.c_str(), path.c_str()) != 0) err = errno;
+  if (err != 0) {
+    unlink(tmp.c_str());
+    throw runtime_error("StageStore: cannot write " + path + ": " + strerror(err));
+  }
+}
+
+string StageStore::path(unsigned Round, unsigned global_bound) const {
+  ostringstream s;
+  s << dir << "/" << cipher << "_R" << Round << "_b" << global_bound << ".dp";
+  return s.str();
+}
+
+string StageStore::path(unsigned Round, unsigned global_bound, unsigned index) const {
+  ostringstream s;
+  s << dir << "/" << cipher << "_R" << Round << "_b" << global_bound << "_s" << index << ".dp";
+  return s.str();
+}
+
+vector<Stage> StageStore::load(unsigned Round, unsigned global_bound, vector<size_t> const & sizes) const {
+  vector<Stage> res;
+  if (!enabled()) return res;
+  auto const manifest = path(Round, global_bound);
+  ifstream in (manifest);
+  string tag;
+  unsigned round = 0, bound = 0;
+  size_t n_stages = 0;
+  if (!getline(in, tag) || tag != formatTag || !(in >> round >> bound >> n_stages) || n_stages != sizes.size()) return res;
+  if (round != Round || bound != global_bound) throw runtime_error("StageStore: " + manifest + " is of other stages");
+  res.reserve(n_stages);
+  for (unsigned i = 0; i < n_stages; ++i) {
+    size_t size = 0;
+    uint64_t sum = 0;
+    if (!(in >> size >> hex >> sum >> dec)) throw runtime_error("StageStore: " + manifest + " is truncated");
+    if (size != sizes[i]) return vector<Stage>();
+    res.emplace_back(Stage::map(path(Round, global_bound, i)));
+    if (res.back().size() != size || checksum(res.back().begin(), size) != sum) {
+      throw runtime_error("StageStore: " + path(Round, global_bound, i) + " does not match its checksum");
+    }
+  }
+  return res;
+}
+
+void StageStore::save(unsigned Round, unsigned global_bound, vector<Stage> & stages) const {
+  if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+    throw runtime_error("StageStore: cannot create " + dir + ": " + strerror(errno));
+  }
+  ostringstream manifest;
+  manifest << formatTag << "\n" << Round << " " << global_bound << "\n" << stages.size() << "\n";
+  for (unsigned i = 0; i < stages.size(); ++i) {
+    auto const file = path(Round, global_bound, i);
+    writeFile(file, reinterpret_cast<char const *>(stages[i].begin()), stages[i].size());
+    manifest << stages[i].size() << " " << hex << checksum(stages[i].begin(), stages[i].size()) << dec << "\n";
+    stages[i] = Stage::map(file);
+  }
+  auto const text = manifest.str();
+  writeFile(path(Round, global_bound), text.data(), text.size());
+}
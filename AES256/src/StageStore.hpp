@@ -0,0 +1,71 @@
+#ifndef DEF_STAGESTORE
+#define DEF_STAGESTORE
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+// A stage (table) of the dynamic program, read-only: held in memory or mapped from a file of a StageStore,
+// in which case the pages are shared through the page cache by all the processes mapping it
+class Stage
+{
+public:
+  Stage() = default;
+  explicit Stage(std::vector<uint8_t> && t) : table(std::move(t)), first(table.data()), n(table.size()) {};
+  Stage(Stage && other) noexcept {*this = std::move(other);};
+  Stage & operator=(Stage && other) noexcept;
+  Stage(Stage const &) = delete;
+  Stage & operator=(Stage const &) = delete;
+  ~Stage() {unmap();};
+
+  // stage of the file path mapped read-only (an empty file gives an empty stage)
+  static Stage map(std::string const & path);
+
+  uint8_t const & operator[](std::size_t i) const {return first[i];};
+  uint8_t const * begin() const {return first;};
+  uint8_t const * end() const {return first + n;};
+  std::size_t size() const {return n;};
+  bool empty() const {return n == 0;};
+
+private:
+  void unmap();
+
+  std::vector<uint8_t> table;
+  void * mapping = nullptr;
+  uint8_t const * first = nullptr;
+  std::size_t n = 0;
+};
+
+
+// Files of the stages in the directory dir: the stage index of the dynamic program of cipher on Round rounds with
+// global_bound is in "cipher_R<Round>_b<global_bound>_s<index>.dp", and the manifest "cipher_R<Round>_b<global_bound>.dp"
+// gives the format of the files, Round and global_bound, and the size and checksum of each stage once all of them are
+// written. Each file is written aside and renamed, so that concurrent processes only see complete files. An empty dir
+// disables the store.
+class StageStore
+{
+public:
+  StageStore(std::string dir, std::string cipher) : dir(std::move(dir)), cipher(std::move(cipher)) {};
+
+  bool enabled() const {return !dir.empty();};
+
+  // the stages of (Round, global_bound) mapped read-only, none if they are not all stored in the current format with
+  // the sizes given (stage i of sizes[i] bytes); throws std::runtime_error if a stored stage cannot be mapped or does
+  // not match the manifest (its checksum, Round or global_bound)
+  std::vector<Stage> load(unsigned Round, unsigned global_bound, std::vector<std::size_t> const & sizes) const;
+
+  // writes the stages of (Round, global_bound) and replaces each of them by its mapping, which releases the tables on
+  // the way; throws std::runtime_error if a file cannot be written or mapped, the stages left are still valid
+  void save(unsigned Round, unsigned global_bound, std::vector<Stage> & stages) const;
+
+private:
+  std::string path(unsigned Round, unsigned global_bound) const;
+  std::string path(unsigned Round, unsigned global_bound, unsigned index) const;
+
+  std::string dir;
+  std::string cipher;
+};
+
+#endif
@@ -1,10 +1,16 @@
 #include <iostream>
 #include <cstdint>
+#include <cstdlib>
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <stdexcept>
 
 #include "SysOfEqs.hpp"
+#include "MinPlus.hpp"
+#include "Layout.hpp"
+#include "Transitions.hpp"
+#include "StageStore.hpp"
 
 using namespace std;
 
@@ -32,154 +38,103 @@ vector<uint8_t> initPop5() {
   return count;
 }
 
-void updateSR(vector<uint8_t> & T, uint8_t const global_bound) {
+void updateSR(vector<uint8_t> const & T, vector<uint8_t> & TT, uint8_t const global_bound) {
   static unsigned const n_states = 5*5*5*5;
   static unsigned const n_keys = 5*5*5*5*5*5*5*5;
-  static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
-  static vector<uint8_t> const count = initPop5();
-  static vector<unsigned> const shiftRows ({0, 1, 2, 3, 7, 4, 5, 6, 10, 11, 8, 9, 13, 14, 15, 12});
-
-  vector<uint8_t> TT (n_states*n_keys, global_bound);
-
-  for (unsigned state = 0; state < n_states; ++state) {
-
-    unsigned mystate[4];
-    for (unsigned c = 0; c < 4; ++c) mystate[c] = (state/mypow[c])%5;
-    sort(&mystate[0], &mystate[0] + 4);
-    unsigned smallest_state = 0;
-    for (unsigned c = 0; c < 4; ++c) {smallest_state *= 5; smallest_state += mystate[c];}
-
-    if (state != smallest_state) {
-      #pragma omp parallel for
-      for (unsigned key = 0; key < n_keys; ++key) {
-        TT[key*n_states + state] = TT[key*n_states + smallest_state];
-      }
-    }
-    else {
-      set<unsigned> all_states;
-      all_states.emplace(0);
-      for (unsigned c = 0; c < 4; ++c) {
-        auto const & u = mystate[c];
-        set<unsigned> tmp;
-        for (unsigned x = 0; x < 16; ++x) {
-          if (__builtin_popcount(x) != u) continue;
-          for (auto y : all_states) {
-            y += ((x >> 0) & 1)*mypow[c];
-            y += ((x >> 1) & 1)*mypow[(c+1)%4];
-            y += ((x >> 2) & 1)*mypow[(c+2)%4];
-            y += ((x >> 3) & 1)*mypow[(c+3)%4];
-            tmp.emplace(y);
-          }
-        }
-        swap(tmp, all_states);
-      }
+  static SRGraph const & graph = srGraph();
 
-      #pragma omp parallel for
-      for (unsigned key = 0; key < n_keys; ++key) {
-        auto & dst = TT[key*n_states + state];
-        for (auto const & s : all_states) {
-          auto const & src = T[key*n_states + s];
-          dst = min(dst, src);
-        }
-      }
+  #pragma omp parallel for
+  for (unsigned key = 0; key < n_keys; ++key) {
+    uint8_t const * t = &T[key*n_states];
+    uint8_t * tt = &TT[key*n_states];
+    for (unsigned state = n_states; state-- > 0;) {
+      unsigned const & sorted_state = graph.canon[state];
+      if (state != sorted_state) {tt[state] = tt[sorted_state]; continue;} // sorted_state > state is done
+      uint8_t dst = global_bound;
+      for (unsigned e = graph.first[state]; e < graph.first[state+1]; ++e) dst = min(dst, t[graph.sources[e]]);
+      tt[state] = dst;
     }
   }
-  swap(T, TT);
 }
 
-vector<unsigned> inv_updateSR(vector<uint8_t> const & T, uint8_t const bound, unsigned state, unsigned key, vector<uint8_t> const & valX) {
+vector<unsigned> inv_updateSR(Stage const & T, uint8_t const bound, unsigned state, unsigned key, vector<uint8_t> const & valX) {
   static unsigned const n_states = 5*5*5*5;
-  static unsigned const mypow[4] = {1, 5, 5*5, 5*5*5};
+  static SRGraph const & graph = srGraph();
+
+  // the patterns p of the bytes compatible with valX: (p & known) == value
+  unsigned known = 0, value = 0;
+  for (unsigned b = 0; b < 16; ++b) {
+    if (valX[b] == 2) continue;
+    known |= 1u << b;
+    value |= unsigned(valX[b]) << b;
+  }
 
   vector<unsigned> res;
 
-  {
-    set<unsigned> all_states;
-    all_states.emplace(0);
-    for (unsigned c = 0; c < 4; ++c) {
-      auto u = (state/mypow[c])%5;
-      set<unsigned> tmp;
-      for (unsigned x = 0; x < 16; ++x) {
-        if (__builtin_popcount(x) != u) continue;
-        if (valX[4*0 + ((c+0)%4)] != 2 && valX[4*0 + ((c+0)%4)] != ((x >> 0) & 1)) continue;
-        if (valX[4*1 + ((c+1)%4)] != 2 && valX[4*1 + ((c+1)%4)] != ((x >> 1) & 1)) continue;
-        if (valX[4*2 + ((c+2)%4)] != 2 && valX[4*2 + ((c+2)%4)] != ((x >> 2) & 1)) continue;
-        if (valX[4*3 + ((c+3)%4)] != 2 && valX[4*3 + ((c+3)%4)] != ((x >> 3) & 1)) continue;
-        for (auto y : all_states) {
-          y += ((x >> 0) & 1)*mypow[c];
-          y += ((x >> 1) & 1)*mypow[(c+1)%4];
-          y += ((x >> 2) & 1)*mypow[(c+2)%4];
-          y += ((x >> 3) & 1)*mypow[(c+3)%4];
-          tmp.emplace(y);
-        }
-      }
-      swap(tmp, all_states);
-    }
-
-    for (auto s : all_states) {
-      auto const & src = T[key*n_states + s];
-      if (src <= bound) res.emplace_back(key*n_states + s);
-    }
+  for (unsigned e = graph.first[state]; e < graph.first[state+1]; ++e) {
+    unsigned const & full = key*n_states + graph.sources[e];
+    if (T[full] > bound) continue;
+    auto const first = graph.patterns.begin() + graph.firstPattern[e], last = graph.patterns.begin() + graph.firstPattern[e+1];
+    if (any_of(first, last, [known, value](uint16_t p) {return (p & known) == value;})) res.emplace_back(full);
   }
   return res;
 }
 
-void updateMC_ARK(vector<uint8_t> & T, unsigned const col, unsigned const dec_key, uint8_t const global_bound) {
+// One column of MixColumns and AddRoundKey on the row of a key with k active bytes in the column of the key
+// added: t -> tt (n_states cells each)
+void updateMC_ARKRow(uint8_t const * t, uint8_t * tt, unsigned const col, int const k, uint8_t const global_bound) {
   static unsigned const n_states = 5*5*5*5;
-  static unsigned const n_keys = 5*5*5*5*5*5*5*5;
-  static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
+  static unsigned const slice = n_states/5;
   static const auto MC16 = initMC16();
 
-  vector<uint8_t> TT (n_states*n_keys, global_bound);
+  // the rows are permuted to put the digit col on top, the states with digit col = x being the slice x
+  auto const & order = topDigitOrder(col);
+  uint8_t row[n_states], rrow[n_states];
+  uint8_t * const out = tt;
+  if (col != 3) {
+    gatherStates(row, t, order);
+    t = row;
+    tt = rrow;
+  }
+  fill(tt, tt + n_states, global_bound);
+  int x = (k == 0) ? 1 : 0;
+  for (auto z : MC16[x+k]) minBelow(tt + x*slice, t + z*slice, x, global_bound, slice);
+  int z = 4 - (x+k);
+  for (++x; x <= 4; ++x) {
+    if (z == 0) addAll(tt + x*slice, tt + (x-1)*slice, 1, slice);
+    else minOfAdds(tt + x*slice, tt + (x-1)*slice, 1, t + z*slice, x, slice);
+    if (z > 0) --z;
+  }
+  minBelow(tt + k*slice, t, k, global_bound, slice);
+  if (col != 3) scatterStates(out, rrow, order);
+}
 
-  unsigned const & colk = (col + dec_key)%8;
+// MixColumns and AddRoundKey on the 4 columns, the column c with the column (c + dec_key)%8 of the key, after the
+// S-boxes of the key (digit 3 + dec_key) when sboxes: T -> TT. The rows are independent, each one goes through the
+// 4 columns in cache
+void updateMC_ARK(vector<uint8_t> const & T, vector<uint8_t> & TT, unsigned const dec_key, bool const sboxes, uint8_t const global_bound) {
+  static unsigned const n_states = 5*5*5*5;
+  static unsigned const n_keys = 5*5*5*5*5*5*5*5;
+  static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
 
   #pragma omp parallel for
-  for (unsigned key_tmp = 0; key_tmp < n_keys/5; ++key_tmp) {
-    unsigned const & kk = (key_tmp/mypow[colk])%5;
-    for (int k = 0; k <= 4; ++k) {
-      unsigned const & key = key_tmp + k*mypow[colk] + kk*(mypow[7] - mypow[colk]);
-      int x = (k == 0) ? 1 : 0;
-      for (auto z : MC16[x+k]) {
-        for (unsigned state_tmp = 0; state_tmp < n_states/5; ++state_tmp) {
-          unsigned const & ss = (state_tmp/mypow[col])%5;
-          unsigned const & state_src = state_tmp + z*mypow[col] + ss*(mypow[3] - mypow[col]);
-          unsigned const & state_dst = state_tmp + x*mypow[col] + ss*(mypow[3] - mypow[col]);
-          uint8_t const & src = T[key*n_states + state_src] + x;
-          if (src >= global_bound) continue;
-          auto & dst = TT[key*n_states + state_dst];
-          dst = min(dst, src);
-        }
-      }
-      int z = 4 - (x+k);
-      for (++x; x <= 4; ++x) {
-        for (unsigned state_tmp = 0; state_tmp < n_states/5; ++state_tmp) {
-          unsigned const & ss = (state_tmp/mypow[col])%5;
-          unsigned const & state_dst = state_tmp + x*mypow[col] + ss*(mypow[3] - mypow[col]);
-          unsigned const & state_src1 = state_tmp + (x-1)*mypow[col] + ss*(mypow[3] - mypow[col]);
-          if (z == 0) TT[key*n_states + state_dst] = TT[key*n_states + state_src1] + 1;
-          else {
-            unsigned const & state_src2 = state_tmp + z*mypow[col] + ss*(mypow[3] - mypow[col]);
-            TT[key*n_states + state_dst] = min(TT[key*n_states + state_src1] + 1, T[key*n_states + state_src2] + x);
-          }
-        }
-        if (z > 0) --z;
-      }
-      for (unsigned state_tmp = 0; state_tmp < n_states/5; ++state_tmp) {
-        unsigned const & ss = (state_tmp/mypow[col])%5;
-        unsigned const & state_src = state_tmp + ss*(mypow[3] - mypow[col]);
-        unsigned const & state_dst = state_tmp + k*mypow[col] + ss*(mypow[3] - mypow[col]);
-        uint8_t const & src = T[key*n_states + state_src] + k;
-        if (src >= global_bound) continue;
-        auto & dst = TT[key*n_states + state_dst];
-        dst = min(dst, src);
-      }
+  for (unsigned key = 0; key < n_keys; ++key) {
+    uint8_t const * src = &T[key*n_states];
+    uint8_t row[2][n_states];
+    if (sboxes) {
+      copy(src, src + n_states, row[1]);
+      addBelow(row[1], (key/mypow[3 + dec_key])%5, global_bound, n_states);
+      src = row[1];
+    }
+    for (unsigned c = 0; c < 4; ++c) {
+      uint8_t * dst = (c == 3) ? &TT[key*n_states] : row[c%2];
+      updateMC_ARKRow(src, dst, c, (key/mypow[(c + dec_key)%8])%5, global_bound);
+      src = dst;
     }
   }
-  swap(T, TT);
 }
 
-vector<unsigned> inv_updateMC_ARK(vector<uint8_t> const & T, unsigned const col_start, uint8_t const bound, unsigned const state, unsigned const key) {
+vector<unsigned> inv_updateMC_ARK(Stage const & T, unsigned const col_start, uint8_t const bound, unsigned const state, unsigned const key) {
   static unsigned const n_states = 5*5*5*5;
   static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
   static const auto MC16 = initMC16();
@@ -220,15 +175,13 @@ vector<unsigned> inv_updateMC_ARK(vector<uint8_t> const & T, unsigned const col_
   return res;
 }
 
-void updateKey256Column(unsigned const col, vector<uint8_t> & T, uint8_t const global_bound) {
+void updateKey256Column(unsigned const col, vector<uint8_t> const & T, vector<uint8_t> & TT, uint8_t const global_bound) {
   static unsigned const n_states = 5*5*5*5;
   static unsigned const n_keys = 5*5*5*5*5*5*5*5;
   static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
   //static vector<uint8_t> const count = initPop5();
   //static const auto MC16 = initMC16();
 
-  vector<uint8_t> TT (n_states*n_keys, global_bound);
-
   unsigned col2 = (col == 0) ? 7 : col-1;
 
   vector<vector<unsigned>> possibleCol (5*5);
@@ -245,6 +198,10 @@ void updateKey256Column(unsigned const col, vector<uint8_t> & T, uint8_t const g
     unsigned const & n7 = (key_tmp/mypow[col])%5;
     vector<unsigned> all_keys;
     all_keys.reserve(5);
+    for (unsigned n0 = 0; n0 <= 4; ++n0) { // the 5 rows written by this iteration only
+      unsigned const & key = key_tmp + n0*mypow[col] + n7*(mypow[7] - mypow[col]);
+      fill(&TT[key*n_states], &TT[key*n_states] + n_states, global_bound);
+    }
     for (unsigned n0 = 0; n0 <= 4; ++n0) {
       unsigned key = key_tmp + n0*mypow[col] + n7*(mypow[7] - mypow[col]);
       unsigned const & n1 = (key/mypow[col2])%5;
@@ -253,20 +210,11 @@ void updateKey256Column(unsigned const col, vector<uint8_t> & T, uint8_t const g
       //if (all_keys.empty()) continue;
       key *= n_states;
 
-      for (unsigned state = 0; state < n_states; ++state) {
-        auto const & src = T[key + state];
-        if (src >= global_bound) continue;
-        //cout << all_keys.size() << " - " << n0 << " - " << n1 << endl;
-        for (auto k : all_keys) {
-          auto & dst = TT[k + state];
-          dst = min(dst, src);
-        }
-      }
+      for (auto k : all_keys) minBelow(&TT[k], &T[key], 0, global_bound, n_states);
       all_keys.clear();
     }
   }
 
-  swap(T,TT);
 }
 
 vector<unsigned> inv_updateKey256Column(unsigned const col, unsigned key, vector<unsigned> & res) {
@@ -288,7 +236,7 @@ vector<unsigned> inv_updateKey256Column(unsigned const col, unsigned key, vector
   return res;
 }
 
-vector<unsigned> inv_updateKey256(int col_start, vector<uint8_t> const & T, uint8_t const bound, unsigned state, unsigned key) {
+vector<unsigned> inv_updateKey256(int col_start, Stage const & T, uint8_t const bound, unsigned state, unsigned key) {
   static unsigned const n_states = 5*5*5*5;
 
   vector<unsigned> res (1, key);
@@ -337,50 +285,80 @@ vector<vector<uint8_t>> computeDynProg(uint8_t const global_bound, unsigned cons
 
   vector<vector<uint8_t>> res;
 
-  res.emplace_back(T);
+  res.emplace_back(move(T));
+
+  // buffers of the key columns between the stages, reused over the rounds; the stages are written by their step
+  T.resize(sizeT);
+  vector<uint8_t> TT (sizeT);
 
   for (unsigned r = 1; r < Round; ++r) {
     if (r != 1) {
-      updateSR(T, global_bound); res.emplace_back(T);
-      for (unsigned c = 0; c < 4; ++c) {
-        updateKey256Column(c + 4*(r%2), T, global_bound);
-      }
-      res.emplace_back(T);
-      for (unsigned k = 0; k < n_keys; ++k) {
-        uint8_t sboxes = (k/mypow[3 + 4*(r%2)])%5;
-        for (unsigned x = 0; x < n_states; ++x) {
-          auto & src = T[k*n_states + x];
-          if (src < global_bound) src += sboxes;
-        }
+      res.emplace_back(sizeT);
+      updateSR(res[res.size()-2], res.back(), global_bound);
+      vector<uint8_t> const * src = &res.back();
+      for (unsigned c = 0; c < 3; ++c) {
+        updateKey256Column(c + 4*(r%2), *src, T, global_bound);
+        swap(T, TT);
+        src = &TT;
       }
+      res.emplace_back(sizeT);
+      updateKey256Column(3 + 4*(r%2), *src, res.back(), global_bound);
     }
     else res.emplace_back(vector<uint8_t>());
-    for (unsigned c = 0; c < 4; ++c) {
-      updateMC_ARK(T, c, 4*(r%2), global_bound);
-    }
-    res.emplace_back(T);
+    res.emplace_back(sizeT);
+    updateMC_ARK(res[res.size() - ((r != 1) ? 2 : 3)], res.back(), 4*(r%2), r != 1, global_bound);
   }
 
   return res;
 }
 
-unsigned searchOnLine(unsigned l, uint8_t x, vector<vector<uint8_t>> const & valX, vector<vector<uint8_t>> const & valK, Matrix const & mat) {
-  for (unsigned c = 0; c < mat.nbcols; ++c) {
-    if (mat(l, c) != 0) {
-      int uu = abs(mat.getColumns(c));
-      int ii = uu%16;
-      int vv = (uu/16)%4;
-      int rr = (uu/16)/4;
-      if (vv == 2 && valX[rr][ii] == x) return c;
-      else if (vv == 1 && valK[rr][ii] == x) return c;
+// sizes of the stages of computeDynProg: the stage 1 is left empty
+vector<size_t> dynProgSizes(unsigned const Round) {
+  static size_t const sizeT = size_t(5*5*5*5)*(5*5*5*5*5*5*5*5);
+  vector<size_t> res (1, sizeT);
+  for (unsigned r = 1; r < Round; ++r) {
+    if (r != 1) res.insert(res.end(), 2, sizeT);
+    else res.emplace_back(0);
+    res.emplace_back(sizeT);
+  }
+  return res;
+}
+
+// stages of computeDynProg, from the stage store of the directory $AESCM_DPSTORE when it is set: they are computed
+// and stored by the first run, the later runs (other bounds of the search, other shards) map them. Stages missing,
+// of another format or size, or that cannot be mapped are computed and stored again
+vector<Stage> loadDynProg(uint8_t const global_bound, unsigned const Round) {
+  char const * dir = getenv("AESCM_DPSTORE");
+  StageStore const store ((dir == nullptr) ? "" : dir, "aes256");
+
+  vector<Stage> res;
+  try {
+    res = store.load(Round, global_bound, dynProgSizes(Round));
+  }
+  catch (runtime_error const & e) {
+    cout << e.what() << ", the stages are computed again" << endl;
+  }
+  if (!res.empty()) {
+    cout << "stages mapped from " << dir << endl;
+    return res;
+  }
+
+  for (auto & t : computeDynProg(global_bound, Round)) res.emplace_back(move(t));
+  if (store.enabled()) {
+    try {
+      store.save(Round, global_bound, res);
+    }
+    catch (runtime_error const & e) {
+      cout << e.what() << ", the stages are kept in memory" << endl;
     }
   }
-  return mat.nbcols;
+  return res;
 }
 
-void set0Mat(int uval, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat) {
+template <unsigned int Poly>
+void set0Mat(int uval, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat) {
   if (mat.setAsPivot(uval, line1, line2)) {
-    unsigned tmp = searchOnLine(line1, 2, valX, valK, mat);
+    unsigned tmp = mat.firstWithValue(line1, 2);
     if (tmp == mat.nbcols) mat.swapLines(line1, --line2);
     else {
       mat.swapLineColumn(line1,tmp);
@@ -388,16 +366,13 @@ void set0Mat(int uval, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> &
     }
   }
   else {
-    for (unsigned ll = 0; ll < mat.nbcols; ++ll) {
-      if (mat.getColumns(ll) == uval) {
-        mat.eraseColumn(ll);
-        break;
-      }
-    }
+    unsigned ll = mat.columnOf(uval);
+    if (ll < mat.nbcols) mat.eraseColumn(ll);
   }
 }
 
-pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   pair<bool, bool> res = make_pair(false, true);
   bool done_x[4] = {false, false, false, false};
   bool done_sr[4] = {false, false, false, false};
@@ -419,7 +394,7 @@ pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vec
           int uuval2 = 16*(4*r + 2) + 4*ll + cc;
           if (mat.setAsPivot(uuval2, line1, line2)) ++line1;
           if (mat.setAsPivot(-uuval2, line1, line2)) ++line1;
-          valX[r][4*ll + cc] = 1;
+          mat.setValue(valX[r][4*ll + cc], uuval2, 1);
           //cout << r << ": " << 4*ll + cc << " (X,1)" << endl;
           if (!done_sr[(cc - ll + 4)%4]) set_sr.emplace((cc - ll + 4)%4);
         }
@@ -431,7 +406,7 @@ pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vec
           int uuval2 = 16*(4*r + 2) + 4*ll + cc;
           set0Mat(uuval2, valX, valK, line1, line2, mat);
           set0Mat(-uuval2, valX, valK, line1, line2, mat);
-          valX[r][4*ll + cc] = 0;
+          mat.setValue(valX[r][4*ll + cc], uuval2, 0);
           //cout << r << ": " << 4*ll + cc << " (X,0)" << endl;
           res.first = true;
           if (!done_sr[(cc - ll + 4)%4]) set_sr.emplace((cc - ll + 4)%4);
@@ -454,7 +429,7 @@ pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vec
           int uuval2 = 16*(4*r + 2) + 4*ll + ((cc+ll)%4);
           if (mat.setAsPivot(uuval2, line1, line2)) ++line1;
           if (mat.setAsPivot(-uuval2, line1, line2)) ++line1;
-          valX[r][4*ll + ((cc+ll)%4)] = 1;
+          mat.setValue(valX[r][4*ll + ((cc+ll)%4)], uuval2, 1);
           //cout << r << ": " << 4*ll + ((cc+ll)%4) << " (SR,1)" << endl;
           if (!done_x[(cc+ll)%4]) set_x.emplace(((cc+ll)%4));
         }
@@ -466,7 +441,7 @@ pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vec
           int uuval2 = 16*(4*r + 2) + 4*ll + ((cc+ll)%4);
           set0Mat(uuval2, valX, valK, line1, line2, mat);
           set0Mat(-uuval2, valX, valK, line1, line2, mat);
-          valX[r][4*ll + ((cc+ll)%4)] = 0;
+          mat.setValue(valX[r][4*ll + ((cc+ll)%4)], uuval2, 0);
           //cout << r << ": " << 4*ll + ((cc+ll)%4) << " (SR,0)" << endl;
           res.first = true;
           if (!done_x[(cc+ll)%4]) set_x.emplace(((cc+ll)%4));
@@ -477,7 +452,8 @@ pair<bool, bool> updateColumns_X(int r, set<int> & set_x, set<int> & set_sr, vec
   return res;
 }
 
-pair<bool, bool> updateColumns(int round_type, int r, int pos, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+pair<bool, bool> updateColumns(int round_type, int r, int pos, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   pair<bool, bool> res = make_pair(false, true);
   if (round_type == 2) {
     set<int> set_x;
@@ -499,7 +475,7 @@ pair<bool, bool> updateColumns(int round_type, int r, int pos, vector<vector<uin
         int uuval2 = 16*(4*r + 1) + 4*ll + cc;
         if (mat.setAsPivot(uuval2, line1, line2)) ++line1;
         if (mat.setAsPivot(-uuval2, line1, line2)) ++line1;
-        valK[r][4*ll + cc] = 1;
+        mat.setValue(valK[r][4*ll + cc], uuval2, 1);
         //cout << r << ": " << 4*ll + cc << " (K,1)" << endl;
       }
     }
@@ -509,7 +485,7 @@ pair<bool, bool> updateColumns(int round_type, int r, int pos, vector<vector<uin
         int uuval2 = 16*(4*r + 1) + 4*ll + cc;
         set0Mat(uuval2, valX, valK, line1, line2, mat);
         set0Mat(-uuval2, valX, valK, line1, line2, mat);
-        valK[r][4*ll + cc] = 0;
+        mat.setValue(valK[r][4*ll + cc], uuval2, 0);
         //cout << r << ": " << 4*ll + cc << " (K,0)" << endl;
         res.first = true;
       }
@@ -518,42 +494,35 @@ pair<bool, bool> updateColumns(int round_type, int r, int pos, vector<vector<uin
   return res;
 }
 
-bool propagateZERO(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+bool propagateZERO(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   bool res = true;
   {
     //cout << "start" << flush;
     unsigned l = line1;
     while (l < line2) {
-      unsigned cc = searchOnLine(l,2, valX, valK, mat);
+      unsigned cc = mat.firstWithValue(l, 2);
       if (cc == mat.nbcols) {
         int uuval = mat.getFront(l);
         int uu = abs(uuval);
-        int ii = uu%16;
-        int vv = (uu/16)%4;
-        int rr = (uu/16)/4;
-        if (vv == 2) valX[rr][ii] = 0;
-        else valK[rr][ii] = 0;
+        int ii = mat.cellOf(uu);
+        int vv = mat.kindOf(uu);
+        int rr = mat.roundOf(uu);
+        if (vv == 2) mat.setValue(valX[rr][ii], uu, 0);
+        else mat.setValue(valK[rr][ii], uu, 0);
         mat.swapLines(l, --line2);
-        unsigned ll = line1;
-        while (ll < line2) {
-          if (mat.getFront(ll) == -uuval) {
-            cc = searchOnLine(ll, 2, valX, valK, mat);
-            if (cc == mat.nbcols) mat.swapLines(ll, --line2);
-            else {
-              mat.swapLineColumn(ll,cc);
-              mat.eraseColumn(cc);
-            }
-            break;
+        unsigned ll = mat.lineOf(-uuval);
+        if (ll >= line1 && ll < line2) {
+          cc = mat.firstWithValue(ll, 2);
+          if (cc == mat.nbcols) mat.swapLines(ll, --line2);
+          else {
+            mat.swapLineColumn(ll,cc);
+            mat.eraseColumn(cc);
           }
-          else ++ll;
         }
-        if (ll == line2) {
-          for (ll = 0; ll < mat.nbcols; ++ll) {
-            if (mat.getColumns(ll) == -uuval) {
-              mat.eraseColumn(ll);
-              break;
-            }
-          }
+        else {
+          ll = mat.columnOf(-uuval);
+          if (ll < mat.nbcols) mat.eraseColumn(ll);
         }
         if (!updateColumns(vv, rr, ii, valX, valK, line1, line2, mat, valColX, valColSR, valColK).second) return false;
         l = line1;
@@ -564,37 +533,22 @@ bool propagateZERO(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & val
   return res;
 }
 
-bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned line1_start, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned line1_start, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   if (line1 == line1_start) return true;
   unsigned l = line1_start;
   while (l < line1) {
-    unsigned cc = 0;
-    unsigned tmp = 0;
-    unsigned x = 0;
-    while (cc < mat.nbcols) {
-      if (mat(l, cc) != 0) {
-        int uu = abs(mat.getColumns(cc));
-        int ii = uu%16;
-        int vv = (uu/16)%4;
-        int rr = (uu/16)/4;
-        if (vv == 2) {
-          if (valX[rr][ii] != 0) {tmp += 3 - valX[rr][ii]; x = cc;}
-        }
-        else {
-          if (valK[rr][ii] != 0) {tmp += 3 - valK[rr][ii]; x = cc;}
-        }
-        if (tmp > 1) break;
-      }
-      ++cc;
-    }
+    // tmp: 0 if every variable of the line is 0, 1 if one is unknown (column x) and the others 0, 2 otherwise
+    unsigned x = mat.firstWithValue(l, 2);
+    unsigned tmp = (mat.firstWithValue(l, 1) != mat.nbcols) ? 2 : min(mat.countWithValue(l, 2), 2u);
     if (tmp == 1) {
       auto uuval = mat.getColumns(x);
       int uu = abs(uuval);
-      int ii = uu%16;
-      int vv = (uu/16)%4;
-      int rr = (uu/16)/4;
-      if (vv == 2) valX[rr][ii] = 1;
-      else valK[rr][ii] = 1;
+      int ii = mat.cellOf(uu);
+      int vv = mat.kindOf(uu);
+      int rr = mat.roundOf(uu);
+      if (vv == 2) mat.setValue(valX[rr][ii], uu, 1);
+      else mat.setValue(valK[rr][ii], uu, 1);
       if (mat.setColumnAsPivot(x, line1, line2)) ++line1;
       else ++l;
       if (mat.setAsPivot(-uuval, line1, line2)) ++line1;
@@ -611,14 +565,12 @@ bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK
     }
   }
   if (l == line2) return true;
-  set<vector<pair<GFElement, int>>> mymap;
+  set<vector<pair<GFElementT<Poly>, int>>> mymap;
   for (l = line1_start; l < line1; ++l) {
-    vector<pair<GFElement, int>> myvec;
+    vector<pair<GFElementT<Poly>, int>> myvec;
     myvec.reserve(mat.nbcols);
-    for (unsigned c = 0; c < mat.nbcols; ++c) {
-      if (mat(l, c) != 0) {
-        myvec.emplace_back(mat(l, c), mat.getColumns(c));
-      }
+    for (unsigned c : mat.nonzeros(l)) {
+      myvec.emplace_back(mat(l, c), mat.getColumns(c));
     }
     if (myvec.empty()) return false;
     auto coef = myvec[0].first.getInverse();
@@ -626,14 +578,12 @@ bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK
     mymap.emplace(move(myvec));
   }
   vector<int> toprocess;
-  vector<pair<GFElement, int>> myvec;
+  vector<pair<GFElementT<Poly>, int>> myvec;
   myvec.reserve(mat.nbcols);
   for (l = line1; l < line2; ++l) {
     myvec.clear();
-    for (unsigned c = 0; c < mat.nbcols; ++c) {
-      if (mat(l, c) != 0) {
-        myvec.emplace_back(mat(l, c), mat.getColumns(c));
-      }
+    for (unsigned c : mat.nonzeros(l)) {
+      myvec.emplace_back(mat(l, c), mat.getColumns(c));
     }
     if (myvec.empty()) continue;
     auto coef = myvec[0].first.getInverse();
@@ -645,11 +595,11 @@ bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK
   for (auto x : toprocess) {
     if (mat.setAsPivot(x, line1, line2)) ++line1;
     int uu = abs(x);
-    int ii = uu%16;
-    int vv = (uu/16)%4;
-    int rr = (uu/16)/4;
-    if (vv == 2) valX[rr][ii] = 1;
-    else valK[rr][ii] = 1;
+    int ii = mat.cellOf(uu);
+    int vv = mat.kindOf(uu);
+    int rr = mat.roundOf(uu);
+    if (vv == 2) mat.setValue(valX[rr][ii], uu, 1);
+    else mat.setValue(valK[rr][ii], uu, 1);
     auto pbool = updateColumns(vv, rr, ii, valX, valK, line1, line2, mat, valColX, valColSR, valColK);
     if (!pbool.second) return false;
     if (pbool.first) {
@@ -668,18 +618,20 @@ bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK
   return propagateONE(valX, valK, line1_start, line1, line2, mat, valColX, valColSR, valColK);
 }
 
-bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+bool propagateONE(vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   return propagateONE(valX, valK, 0, line1, line2, mat, valColX, valColSR, valColK);
 }
 
 
-bool updateStateVar(uint8_t x, unsigned r, unsigned l, unsigned c, Matrix & mat, unsigned & line1, unsigned & line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+bool updateStateVar(uint8_t x, unsigned r, unsigned l, unsigned c, MatrixT<Poly> & mat, unsigned & line1, unsigned & line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   if (valX[r][4*l + c] != 2) return valX[r][4*l + c] == x;
   int uval = 16*(4*r + 2) + 4*l + c;
   if (x == 0) {
     set0Mat(uval, valX, valK, line1, line2, mat);
     set0Mat(-uval, valX, valK, line1, line2, mat);
-    valX[r][4*l + c] = 0;
+    mat.setValue(valX[r][4*l + c], uval, 0);
     //cout << r << ": " << 4*l + c << " (0)" << endl;
     //getchar();
     auto pbool = updateColumns(2, r, 4*l + c, valX, valK, line1, line2, mat, valColX, valColSR, valColK);
@@ -689,7 +641,7 @@ bool updateStateVar(uint8_t x, unsigned r, unsigned l, unsigned c, Matrix & mat,
   else {
     if (mat.setAsPivot(uval, line1, line2)) ++line1;
     if (mat.setAsPivot(-uval, line1, line2)) ++line1;
-    valX[r][4*l + c] = 1;
+    mat.setValue(valX[r][4*l + c], uval, 1);
     //cout << r << ": " << 4*l + c << " (1)" << endl;
     auto pbool = updateColumns(2, r, 4*l + c, valX, valK, line1, line2, mat, valColX, valColSR, valColK);
     if (!pbool.second) return false;
@@ -698,13 +650,14 @@ bool updateStateVar(uint8_t x, unsigned r, unsigned l, unsigned c, Matrix & mat,
   return propagateONE(valX, valK, line1, line2, mat, valColX, valColSR, valColK);
 }
 
-bool updateKeyVar(uint8_t x, unsigned r, unsigned l, unsigned c, Matrix & mat, unsigned & line1, unsigned & line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
+template <unsigned int Poly>
+bool updateKeyVar(uint8_t x, unsigned r, unsigned l, unsigned c, MatrixT<Poly> & mat, unsigned & line1, unsigned & line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> const & valColX, vector<vector<uint8_t>> const & valColSR, vector<vector<uint8_t>> const & valColK) {
   if (valK[r][4*l + c] != 2) return valK[r][4*l + c] == x;
   int uval = 16*(4*r + 1) + 4*l + c;
   if (x == 0) {
     set0Mat(uval, valX, valK, line1, line2, mat);
     set0Mat(-uval, valX, valK, line1, line2, mat);
-    valK[r][4*l + c] = 0;
+    mat.setValue(valK[r][4*l + c], uval, 0);
     auto pbool = updateColumns(1, r, 4*l + c, valX, valK, line1, line2, mat, valColX, valColSR, valColK);
     if (!pbool.second) return false;
     if (!propagateZERO(valX, valK, line1, line2, mat, valColX, valColSR, valColK)) return false;
@@ -712,7 +665,7 @@ bool updateKeyVar(uint8_t x, unsigned r, unsigned l, unsigned c, Matrix & mat, u
   else {
     if (mat.setAsPivot(uval, line1, line2)) ++line1;
     if (mat.setAsPivot(-uval, line1, line2)) ++line1;
-    valK[r][4*l + c] = 1;
+    mat.setValue(valK[r][4*l + c], uval, 1);
     auto pbool = updateColumns(1, r, 4*l + c, valX, valK, line1, line2, mat, valColX, valColSR, valColK);
     if (!pbool.second) return false;
     if (pbool.first && !propagateZERO(valX, valK, line1, line2, mat, valColX, valColSR, valColK)) return false;
@@ -721,7 +674,8 @@ bool updateKeyVar(uint8_t x, unsigned r, unsigned l, unsigned c, Matrix & mat, u
 }
 
 
-bool updateColX(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColSR, vector<vector<uint8_t>> & valColK) {
+template <unsigned int Poly>
+bool updateColX(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColSR, vector<vector<uint8_t>> & valColK) {
   unsigned cpt[3] = {0,0,0};
   for (unsigned l = 0; l < 4; ++l) cpt[valX[r][4*l+c]] += 1;
   if (cpt[0] > 4-valColX[r][c] || cpt[1] > valColX[r][c]) return false;
@@ -742,7 +696,8 @@ bool updateColX(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<v
   return true;
 }
 
-bool updateColSR(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColSR, vector<vector<uint8_t>> & valColK) {
+template <unsigned int Poly>
+bool updateColSR(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColSR, vector<vector<uint8_t>> & valColK) {
   unsigned cpt[3] = {0,0,0};
   for (unsigned l = 0; l < 4; ++l) cpt[valX[r][4*l+((c+l)%4)]] += 1;
   if (cpt[0] > 4-valColSR[r][c] || cpt[1] > valColSR[r][c]) return false;
@@ -762,7 +717,8 @@ bool updateColSR(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<
   return true;
 }
 
-bool updateColK(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, Matrix & mat, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColSR, vector<vector<uint8_t>> & valColK) {
+template <unsigned int Poly>
+bool updateColK(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, unsigned & line1, unsigned & line2, MatrixT<Poly> & mat, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColSR, vector<vector<uint8_t>> & valColK) {
   unsigned cpt[3] = {0,0,0};
   for (unsigned l = 0; l < 4; ++l) cpt[valK[r][4*l+c]] += 1;
   if (cpt[0] > 4-valColK[r][c] || cpt[1] > valColK[r][c]) return false;
@@ -784,7 +740,8 @@ bool updateColK(unsigned r, unsigned c, vector<vector<uint8_t>> & valX, vector<v
 
 
 
-pair<bool,bool> constraintMC(unsigned rk, unsigned ck, unsigned deck, unsigned r1, unsigned c1, unsigned r2, unsigned c2, Matrix & mat, unsigned & line1, unsigned & line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColK, vector<vector<uint8_t>> & valColSR) {
+template <unsigned int Poly>
+pair<bool,bool> constraintMC(unsigned rk, unsigned ck, unsigned deck, unsigned r1, unsigned c1, unsigned r2, unsigned c2, MatrixT<Poly> & mat, unsigned & line1, unsigned & line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColK, vector<vector<uint8_t>> & valColSR) {
   pair<bool, bool> res = make_pair(true, false);
   //return res;
   if (valColK[r1][c1] != 0 && valColK[r2][c2] != 0) {
@@ -863,7 +820,8 @@ pair<bool,bool> constraintMC(unsigned rk, unsigned ck, unsigned deck, unsigned r
 
 bool flag_solution_found = false;
 
-void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_t & global_bound, uint8_t current_bound, int step, Matrix & mat, unsigned line1, unsigned line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColK, vector<vector<uint8_t>> & valColSR) {
+template <unsigned int Poly>
+void findBestTrail(unsigned state_key, vector<Stage> const & T, uint8_t & global_bound, uint8_t current_bound, int step, MatrixT<Poly> & mat, unsigned line1, unsigned line2, vector<vector<uint8_t>> & valX, vector<vector<uint8_t>> & valK, vector<vector<uint8_t>> & valColX, vector<vector<uint8_t>> & valColK, vector<vector<uint8_t>> & valColSR) {
   static unsigned const n_states = 5*5*5*5;
   static unsigned const n_keys = 5*5*5*5*5*5*5*5;
   static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
@@ -883,14 +841,13 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
           for (unsigned l = 0; l < 4; ++l) {
             if (valK[r][4*l + c] == 2) {
               {
-                auto m = mat;
-                auto vX = valX;
-                auto vK = valK;
+                auto const mark = mat.checkpoint();
                 auto l1 = line1;
                 auto l2 = line2;
-                if (updateKeyVar(0, r, l, c, m, l1, l2, vX, vK, valColX, valColSR, valColK)) {
-                  findBestTrail(state_key, T, global_bound, current_bound, step, m, l1, l2, vX, vK, valColX, valColK, valColSR);
+                if (updateKeyVar(0, r, l, c, mat, l1, l2, valX, valK, valColX, valColSR, valColK)) {
+                  findBestTrail(state_key, T, global_bound, current_bound, step, mat, l1, l2, valX, valK, valColX, valColK, valColSR);
                 }
+                mat.rewind(mark);
               }
               if (updateKeyVar(1, r, l, c, mat, line1, line2, valX, valK, valColX, valColSR, valColK)) {
                 return findBestTrail(state_key, T, global_bound, current_bound, step, mat, line1, line2, valX, valK, valColX, valColK, valColSR);
@@ -906,14 +863,13 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
         for (unsigned c = 0; c < 4; ++c) {
           if (valX[r][4*l + c] == 2) {
             {
-              auto m = mat;
-              auto vX = valX;
-              auto vK = valK;
+              auto const mark = mat.checkpoint();
               auto l1 = line1;
               auto l2 = line2;
-              if (updateStateVar(0, r, l, c, m, l1, l2, vX, vK, valColX, valColSR, valColK)) {
-                findBestTrail(state_key, T, global_bound, current_bound, step, m, l1, l2, vX, vK, valColX, valColK, valColSR);
+              if (updateStateVar(0, r, l, c, mat, l1, l2, valX, valK, valColX, valColSR, valColK)) {
+                findBestTrail(state_key, T, global_bound, current_bound, step, mat, l1, l2, valX, valK, valColX, valColK, valColSR);
               }
+              mat.rewind(mark);
             }
             if (updateStateVar(1, r, l, c, mat, line1, line2, valX, valK, valColX, valColSR, valColK)) {
               return findBestTrail(state_key, T, global_bound, current_bound, step, mat, line1, line2, valX, valK, valColX, valColK, valColSR);
@@ -934,12 +890,7 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
 
     for (unsigned i = 0; i < 16; ++i) {
       if (valK[0][i] != 0 || valX[0][i] != 0 || valK[1][i] != 0) {
-        auto m = mat;
-        auto vX = valX;
-        auto vK = valK;
-        auto l1 = line1;
-        auto l2 = line2;
-        return findBestTrail(state_key, T, global_bound, current_bound, step, m, l1, l2, vX, vK, valColX, valColK, valColSR);
+        return findBestTrail(state_key, T, global_bound, current_bound, step, mat, line1, line2, valX, valK, valColX, valColK, valColSR);
       }
     }
 
@@ -1000,14 +951,13 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
       for (unsigned c = 0; c < 4; ++c) {
         valColX[r][c] = (f/mypow[c])%5;
       }
-      auto m = mat;
-      auto vX = valX;
-      auto vK = valK;
+      auto const mark = mat.checkpoint();
       auto l1 = line1;
       auto l2 = line2;
       bool isvalid = true;
-      for (unsigned c = 0; (c < 4) && isvalid; ++c) isvalid = updateColX(r, c, vX, vK, l1, l2, m, valColX, valColSR, valColK);
-      if (isvalid) findBestTrail(f, T, global_bound, current_bound, step-1, m, l1, l2, vX, vK, valColX, valColK, valColSR);
+      for (unsigned c = 0; (c < 4) && isvalid; ++c) isvalid = updateColX(r, c, valX, valK, l1, l2, mat, valColX, valColSR, valColK);
+      if (isvalid) findBestTrail(f, T, global_bound, current_bound, step-1, mat, l1, l2, valX, valK, valColX, valColK, valColSR);
+      mat.rewind(mark);
     }
     for (unsigned c = 0; c < 4; ++c) {
       valColX[r][c] = 5;
@@ -1024,14 +974,13 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
 
       for (auto f : next_state_key) {
         for (unsigned c = 0; c < 4; ++c) valColK[r-1][c] = ((f/n_states)/mypow[c+dec_key])%5;
-        auto m = mat;
-        auto vX = valX;
-        auto vK = valK;
+        auto const mark = mat.checkpoint();
         auto l1 = line1;
         auto l2 = line2;
         bool isvalid = true;
-        for (unsigned c = 0; (c < 4) && isvalid; ++c) isvalid = updateColK(r-1, c, vX, vK, l1, l2, m, valColX, valColSR, valColK);
-        if (isvalid) findBestTrail(f, T, global_bound, current_bound, step-1, m, l1, l2, vX, vK, valColX, valColK, valColSR);
+        for (unsigned c = 0; (c < 4) && isvalid; ++c) isvalid = updateColK(r-1, c, valX, valK, l1, l2, mat, valColX, valColSR, valColK);
+        if (isvalid) findBestTrail(f, T, global_bound, current_bound, step-1, mat, l1, l2, valX, valK, valColX, valColK, valColSR);
+        mat.rewind(mark);
       }
       for (unsigned c = 0; c < 4; ++c) valColK[r-1][c] = 5;
     }
@@ -1043,16 +992,15 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
       for (auto f : next_state_key) {
         for (unsigned c = 0; c < 4; ++c) valColSR[r][c] = ((f%n_states)/mypow[c])%5;
 
-        auto m = mat;
-        auto vX = valX;
-        auto vK = valK;
+        auto const mark = mat.checkpoint();
         auto l1 = line1;
         auto l2 = line2;
         bool isvalid = true;
-        for (unsigned c = 0; (c < 4) && isvalid; ++c) isvalid = updateColSR(r, c, vX, vK, l1, l2, m, valColX, valColSR, valColK);
+        for (unsigned c = 0; (c < 4) && isvalid; ++c) isvalid = updateColSR(r, c, valX, valK, l1, l2, mat, valColX, valColSR, valColK);
         if (isvalid) {
-          findBestTrail(f, T, global_bound, current_bound + valColX[r+1][0] + valColX[r+1][1] + valColX[r+1][2] + valColX[r+1][3] + ((f/n_states)/mypow[3+dec_key])%5, step-1, m, l1, l2, vX, vK, valColX, valColK, valColSR);
+          findBestTrail(f, T, global_bound, current_bound + valColX[r+1][0] + valColX[r+1][1] + valColX[r+1][2] + valColX[r+1][3] + ((f/n_states)/mypow[3+dec_key])%5, step-1, mat, l1, l2, valX, valK, valColX, valColK, valColSR);
         }
+        mat.rewind(mark);
       }
       for (unsigned c = 0; c < 4; ++c) valColSR[r][c] = 5;
     }
@@ -1060,26 +1008,17 @@ void findBestTrail(unsigned state_key, vector<vector<uint8_t>> const & T, uint8_
 }
 
 
-int main(int argc, char const *argv[]) {
-  unsigned Round = stoi(argv[1]);
-
+// search on Round rounds with the systems over the field Poly
+template <unsigned int Poly>
+int searchTrails(unsigned Round) {
   static unsigned const n_states = 5*5*5*5;
   static unsigned const n_keys = 5*5*5*5*5*5*5*5;
   static unsigned const mypow[8] = {1, 5, 5*5, 5*5*5, 5*5*5*5, 5*5*5*5*5, 5*5*5*5*5*5, 5*5*5*5*5*5*5};
 
   {
-    auto mat = AES256eqs(Round);
-
-    unsigned pivot = 0;
-    for (unsigned r = 0; r <= 4*Round+2; ++r) {
-      for (unsigned i = 0; i < 16; ++i) {
-        if ((r%4 == 2 && r < 4*Round+2) || (r%4 == 1 && r < 4*Round+1)) continue;
-        if (mat.setAsPivot(16*r + i, pivot)) ++pivot;
-      }
-    }
-
-    mat = mat.extract(pivot);
+    auto mat = searchSystem(AES256eqs<Poly>, Round);
     cout << mat << endl;
+    cout << "nonzeros: " << mat.weight() << " (" << mat.nblines << " lines, " << mat.nbcols << " columns)" << endl;
     //getchar();
     unsigned bound = 0;
     for (unsigned r = 0; r < Round; ++r) {
@@ -1097,7 +1036,7 @@ int main(int argc, char const *argv[]) {
 
       static vector<uint8_t> const count = initPop5();
 
-      auto T = computeDynProg(global_bound, Round);
+      auto T = loadDynProg(global_bound, Round);
       uint8_t my_min = global_bound;
       for (auto x : T.back()) {
         if (x < my_min) my_min = x;
@@ -1152,3 +1091,8 @@ int main(int argc, char const *argv[]) {
 
   return 0;
 }
+
+int main(int argc, char const *argv[]) {
+  unsigned Round = stoi(argv[1]);
+  return GFieldDispatch(fieldOfRun(), [Round](auto field) {return searchTrails<decltype(field)::value>(Round);});
+}
@@ -0,0 +1,153 @@
+// The solutions of a matrix: count against enumerate on hand-built and random spaces, and the spaces of solutions
+// and the solutions walked by enumerate against a brute force over all the values of the variables of small systems
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Matrix.hpp"
+
+using namespace std;
+
+static unsigned failures = 0;
+
+static void check(bool ok, string const & what) {
+  if (ok) return;
+  ++failures;
+  cerr << "FAILED: " << what << endl;
+}
+
+// count and enumerate on the subsets of the first 4 variables of space, then on all of them
+template <unsigned int Poly>
+static void compareCounts(MatrixT<Poly> const & mat, typename MatrixT<Poly>::Solutions const & space, string const & where) {
+  typedef typename MatrixT<Poly>::GFElement GFElement;
+  unsigned const n = min<unsigned>(space.vars.size(), 4);
+  for (unsigned s = 0; s <= (1u << n); ++s) {
+    vector<int> nonzeros;
+    for (unsigned p = 0; p < space.vars.size(); ++p) {
+      if (s == (1u << n) || (p < n && ((s >> p) & 1) != 0)) nonzeros.emplace_back(space.vars[p]);
+    }
+    auto const all = [](vector<GFElement> const &) {return true;};
+    check(mat.count(space, nonzeros) == mat.enumerate(space, nonzeros, all), where + ": count, subset " + to_string(s));
+  }
+}
+
+static void handBuiltSpaces() {
+  Matrix::Equations sys;
+  sys.add(1, 0); sys.add(1, 1); sys.add(1, 2); sys.close();
+  sys.add(1, 1); sys.add(2, 3); sys.close();
+  sys.add(1, 2); sys.add(1, 3); sys.add(1, 4); sys.close();
+  Matrix const mat (sys);
+  compareCounts(mat, mat.solutions({}), "solutions");
+  compareCounts(mat, mat.solutions({3}), "solutions with 3 = 0");
+  // two components and a position null on the whole space
+  compareCounts(mat, Matrix::Solutions {{10, 11, 12, 13}, {{1, 0, 0, 0}, {0, 1, 3, 0}}}, "components");
+  // 16 columns of distinct directions on a plane, counted by enumerate on the span
+  Matrix::Solutions wide;
+  wide.basis.resize(2);
+  for (unsigned c = 0; c < 16; ++c) {
+    wide.vars.emplace_back(c);
+    wide.basis[0].emplace_back((c < 15) ? 1 : 0);
+    wide.basis[1].emplace_back((c < 15) ? c : 1);
+  }
+  compareCounts(mat, wide, "plane");
+}
+
+// random systems over the field Poly with at most maxvars variables, some of them set to zero or required nonzero
+template <unsigned int Poly>
+static void randomSystems(string const & field, unsigned systems, unsigned maxvars) {
+  typedef MatrixT<Poly> Mat;
+  typedef typename Mat::GFElement GFElement;
+  unsigned const card = 1u << GFieldDim(Poly);
+  mt19937 rng (Poly);
+
+  for (unsigned t = 0; t < systems; ++t) {
+    string const where = field + " system " + to_string(t);
+    unsigned const nvars = 2 + rng()%(maxvars - 1), neqs = 1 + rng()%3;
+    vector<vector<pair<GFElement, int>>> eqs;
+    typename Mat::Equations sys;
+    for (unsigned e = 0; e < neqs; ++e) {
+      eqs.emplace_back();
+      for (unsigned x = 0; x < nvars; ++x) {
+        if (rng()%2 == 0) eqs.back().emplace_back(GFElement(GFSymbol(1 + rng()%(card - 1))), x);
+      }
+      if (eqs.back().empty()) eqs.back().emplace_back(1, 0);
+      for (auto const & p : eqs.back()) sys.add(p.first, p.second);
+      sys.close();
+    }
+    Mat const mat (sys);
+    vector<int> zeros, nonzeros;
+    for (unsigned x = 0; x < nvars; ++x) {
+      auto const r = rng()%4;
+      if (r == 0) zeros.emplace_back(x);
+      else if (r == 1) nonzeros.emplace_back(x);
+    }
+    auto const space = mat.solutions(zeros);
+    auto const & vars = space.vars;
+
+    // brute force on the variables of the matrix: the solutions of the equations with the zeros, then those with the
+    // nonzeros too
+    uint64_t total = 1;
+    for (unsigned i = 0; i < vars.size(); ++i) total *= card;
+    uint64_t kernel = 0;
+    set<vector<GFSymbol>> expected;
+    vector<GFElement> value (nvars, 0);
+    for (uint64_t a = 0; a < total; ++a) {
+      uint64_t y = a;
+      for (auto x : vars) {value[x] = GFElement(GFSymbol(y%card)); y /= card;}
+      bool ok = true;
+      for (auto const & eq : eqs) {
+        GFElement s = 0;
+        for (auto const & p : eq) s += p.first*value[p.second];
+        ok = ok && (s == 0);
+      }
+      for (auto x : zeros) ok = ok && (value[x] == 0);
+      if (!ok) continue;
+      ++kernel;
+      for (auto x : nonzeros) ok = ok && (value[x] != 0 || find(vars.begin(), vars.end(), x) == vars.end());
+      if (!ok) continue;
+      vector<GFSymbol> sol;
+      for (auto x : vars) sol.emplace_back(value[x].getValue());
+      expected.emplace(move(sol));
+    }
+
+    // a basis of the solutions: its vectors are solutions, and it spans as many of them as the brute force finds
+    uint64_t spanned = 1;
+    for (unsigned i = 0; i < space.dimension(); ++i) spanned *= card;
+    check(spanned == kernel, where + ": dimension " + to_string(space.dimension()));
+    for (auto const & b : space.basis) {
+      fill(value.begin(), value.end(), 0);
+      for (unsigned p = 0; p < vars.size(); ++p) value[vars[p]] = b[p];
+      bool ok = true;
+      for (auto const & eq : eqs) {
+        GFElement s = 0;
+        for (auto const & p : eq) s += p.first*value[p.second];
+        ok = ok && (s == 0);
+      }
+      for (auto x : zeros) ok = ok && (value[x] == 0);
+      check(ok, where + ": basis vector");
+    }
+
+    set<vector<GFSymbol>> walked;
+    auto const found = mat.enumerate(space, nonzeros, [&](vector<GFElement> const & sol) {
+      vector<GFSymbol> s;
+      for (auto const & v : sol) s.emplace_back(v.getValue());
+      walked.emplace(move(s));
+      return true;
+    });
+    check(found == expected.size() && walked == expected, where + ": enumerate");
+    check(mat.count(space, nonzeros) == expected.size(), where + ": count");
+    compareCounts(mat, space, where);
+  }
+}
+
+int main() {
+  handBuiltSpaces();
+  randomSystems<0x02>("F_2", 300, 12);
+  randomSystems<0x13>("GF(16)", 300, 5);
+  if (failures != 0) cerr << failures << " checks failed" << endl;
+  return (failures == 0) ? 0 : 1;
+}
@@ -133,8 +133,8 @@ void mycallback::callback()
 			unsigned l = mat.checkZ(X);
 			if (l < mat.nblines) {
 				GRBLinExpr e = 1-varsD[abs(mat.getFront(l))];
-				for (unsigned c = 0; c < mat.nbcols; ++c) {
-					if (mat(l, c) != 0) e += varsD[abs(mat.getColumns(c))];
+				for (unsigned c : mat.nonzeros(l)) {
+					e += varsD[abs(mat.getColumns(c))];
 				}
 				addLazy(e >= 1);
 				//mat.printLine(l);
@@ -25,38 +25,285 @@
 #define DEF_GFIELD
 
 #include <cstdint>
+#include <cstring>
+#include <array>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
 
 typedef uint8_t GFSymbol;
 
+// Compile-time construction of the tables of GF(2^n) (see GField below)
+
+constexpr unsigned int GFieldDim(unsigned int poly)
+{
+	unsigned int dim = 0;
+	while (poly > 1)
+	{
+		poly >>= 1;
+		++dim;
+	}
+	return dim;
+}
+
+template <unsigned int Poly>
+constexpr std::array<GFSymbol, (1u << (2*GFieldDim(Poly)))> GFieldMultTable()
+{
+	constexpr unsigned int dim = GFieldDim(Poly);
+	constexpr unsigned int card = 1u << dim;
+	std::array<GFSymbol, card*card> table {};
+	for (unsigned int i = 0; i < card; ++i)
+	{
+		for (unsigned int j = i; j < card; ++j)
+		{
+			unsigned int x = i;
+			unsigned int y = j;
+
+			// Compute and store i*j
+			unsigned int res = 0;
+			for (unsigned int k = 0; k < dim; ++k)
+			{
+				if (x%2 == 1) res ^= y;
+				x >>= 1;
+				y <<= 1;
+				if (y >= card) y ^= Poly;
+			}
+			table[(i << dim) | j] = static_cast<GFSymbol>(res);
+			table[(j << dim) | i] = static_cast<GFSymbol>(res);
+		}
+	}
+	return table;
+}
+
+// Construction of the table of inverses (0 is mapped to 0)
+template <unsigned int Poly>
+constexpr std::array<GFSymbol, (1u << GFieldDim(Poly))> GFieldInvTable()
+{
+	constexpr unsigned int dim = GFieldDim(Poly);
+	constexpr unsigned int card = 1u << dim;
+	constexpr auto mult = GFieldMultTable<Poly>();
+	std::array<GFSymbol, card> table {};
+	for (unsigned int i = 1; i < card; ++i)
+	{
+		for (unsigned int j = 1; j < card; ++j)
+		{
+			if (mult[(i << dim) | j] == 1)
+			{
+				table[i] = static_cast<GFSymbol>(j);
+				break;
+			}
+		}
+	}
+	return table;
+}
+
+// Split-nibble tables: entry c*32 + i is c*i and entry c*32 + 16 + i is c*(i << 4), for i < 16
+template <unsigned int Poly>
+constexpr std::array<GFSymbol, 32*(1u << GFieldDim(Poly))> GFieldNibbleTables()
+{
+	constexpr unsigned int dim = GFieldDim(Poly);
+	constexpr unsigned int card = 1u << dim;
+	constexpr auto mult = GFieldMultTable<Poly>();
+	std::array<GFSymbol, 32*card> table {};
+	for (unsigned int c = 0; c < card; ++c)
+	{
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			if (i < card) table[32*c + i] = mult[(c << dim) | i];
+			if ((i << 4) < card) table[32*c + 16 + i] = mult[(c << dim) | (i << 4)];
+		}
+	}
+	return table;
+}
+
+// Check if each non-zero element has an inverse
+template <unsigned int Poly>
+constexpr bool GFieldIsField()
+{
+	constexpr auto inv = GFieldInvTable<Poly>();
+	for (unsigned int i = 1; i < inv.size(); ++i) if (inv[i] == 0) return false;
+	return true;
+}
+
+
 /**
- *  @brief     Represent a finite field GF(2^n)
+ *  @brief     Represent the finite field GF(2^n) defined by the polynomial Poly
+ *  @details   The multiplication and inverse tables are flat arrays built at compile time,
+ *             so multiply() is a single indexed load. Poly = 0x02 gives the field F_2.
  *  @warning   The polynomial has to be irreductible!
  */
 
+template <unsigned int Poly>
 class GField
 {
 	public:
-		GField(unsigned int poly);
-		GField(GField const& gf);
-		~GField();
+		static constexpr unsigned int getDim() {return m_dim;};
+		static constexpr unsigned int getCard() {return m_card;};
+		static constexpr unsigned int getPoly() {return Poly;};
 
-		unsigned int getDim() const {return m_dim;};
-		unsigned int getCard() const {return m_card;};
-		unsigned int getPoly() const {return m_poly;};
+		static GFSymbol inverse(const GFSymbol val) {return m_inv_table[val];};
+		static GFSymbol multiply(const GFSymbol val1, const GFSymbol val2) {return m_mult_table[(static_cast<unsigned int>(val1) << m_dim) | val2];};
 
-		GFSymbol inverse(const GFSymbol val) const {return m_inv_table[val];};
-		GFSymbol multiply(const GFSymbol val1, const GFSymbol val2) const {return m_mult_table[val1][val2];};
+		// Row kernels: dst[i] += coef*src[i] and row[i] *= coef for i < n
+		static void row_axpy(GFSymbol * dst, GFSymbol const * src, const GFSymbol coef, const unsigned int n);
+		static void row_scale(GFSymbol * row, const GFSymbol coef, const unsigned int n);
 
 	private:
 
-		const unsigned int m_poly;
-		unsigned int m_dim;
-		unsigned int m_card;
+		static constexpr unsigned int m_dim = GFieldDim(Poly);
+		static constexpr unsigned int m_card = 1u << m_dim;
+
+		static_assert(m_dim >= 1 && m_dim <= 8, "GField: a GFSymbol only holds elements of GF(2^n) for n <= 8");
+		static_assert(GFieldIsField<Poly>(), "Error in Field construction -> it's not a field!!!");
+
+		static constexpr std::array<GFSymbol, m_card*m_card> m_mult_table = GFieldMultTable<Poly>();
+		static constexpr std::array<GFSymbol, m_card> m_inv_table = GFieldInvTable<Poly>();
+		alignas(16) static constexpr std::array<GFSymbol, 32*m_card> m_nibble_table = GFieldNibbleTables<Poly>();
 
-		GFSymbol * m_space_mult_table;
-		GFSymbol ** m_mult_table;
-		GFSymbol * m_inv_table;
+#if defined(__AVX2__)
+		// 32 products coef*x at once: two PSHUFB lookups on the low and high nibbles of x
+		static __m256i multiply(const __m256i x, const __m256i lo, const __m256i hi)
+		{
+			const __m256i mask = _mm256_set1_epi8(0x0f);
+			const __m256i xlo = _mm256_and_si256(x, mask);
+			const __m256i xhi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+			return _mm256_xor_si256(_mm256_shuffle_epi8(lo, xlo), _mm256_shuffle_epi8(hi, xhi));
+		}
+#elif defined(__SSSE3__)
+		static __m128i multiply(const __m128i x, const __m128i lo, const __m128i hi)
+		{
+			const __m128i mask = _mm_set1_epi8(0x0f);
+			const __m128i xlo = _mm_and_si128(x, mask);
+			const __m128i xhi = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+			return _mm_xor_si128(_mm_shuffle_epi8(lo, xlo), _mm_shuffle_epi8(hi, xhi));
+		}
+#endif
 };
 
 
+template <unsigned int Poly>
+inline void GField<Poly>::row_axpy(GFSymbol * dst, GFSymbol const * src, const GFSymbol coef, const unsigned int n)
+{
+	if (coef == 0) return;
+	unsigned int i = 0;
+	if (Poly == 0x02 || coef == 1) // coef*src = src
+	{
+#if defined(__AVX2__)
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(d, s));
+		}
+#endif
+		for (; i < n; ++i) dst[i] ^= src[i];
+		return;
+	}
+#if defined(__GFNI__) && defined(__AVX2__)
+	if (Poly == 0x11b) // GF2P8MULB implements the AES field
+	{
+		const __m256i c = _mm256_set1_epi8(static_cast<char>(coef));
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(d, _mm256_gf2p8mul_epi8(s, c)));
+		}
+	}
+#endif
+#if defined(__AVX2__)
+	{
+		const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef])));
+		const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef + 16])));
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(d, multiply(s, lo, hi)));
+		}
+	}
+#elif defined(__SSSE3__)
+	{
+		const __m128i lo = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef]));
+		const __m128i hi = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef + 16]));
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(d, multiply(s, lo, hi)));
+		}
+	}
+#endif
+	for (; i < n; ++i) dst[i] ^= multiply(coef, src[i]);
+}
+
+template <unsigned int Poly>
+inline void GField<Poly>::row_scale(GFSymbol * row, const GFSymbol coef, const unsigned int n)
+{
+	if (coef == 0)
+	{
+		if (n != 0) std::memset(row, 0, n);
+		return;
+	}
+	if (Poly == 0x02 || coef == 1) return;
+	unsigned int i = 0;
+#if defined(__GFNI__) && defined(__AVX2__)
+	if (Poly == 0x11b)
+	{
+		const __m256i c = _mm256_set1_epi8(static_cast<char>(coef));
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(row + i), _mm256_gf2p8mul_epi8(x, c));
+		}
+	}
+#endif
+#if defined(__AVX2__)
+	{
+		const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef])));
+		const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef + 16])));
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(row + i), multiply(x, lo, hi));
+		}
+	}
+#elif defined(__SSSE3__)
+	{
+		const __m128i lo = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef]));
+		const __m128i hi = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_nibble_table[32*coef + 16]));
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), multiply(x, lo, hi));
+		}
+	}
+#endif
+	for (; i < n; ++i) row[i] = multiply(coef, row[i]);
+}
+
+
+/**
+ *  @brief     Pick the field once at runtime
+ *  @details   Calls f(std::integral_constant<unsigned int, Poly>()) for Poly == poly, so that f is
+ *             compiled once per field and runs with the field as a compile-time constant.
+ *             The fields listed here are the ones for which MatrixT is instantiated.
+ */
+
+template <typename Function>
+auto GFieldDispatch(const unsigned int poly, Function && f)
+{
+	switch (poly)
+	{
+		case 0x02: return f(std::integral_constant<unsigned int, 0x02>()); // F_2
+		case 0x13: return f(std::integral_constant<unsigned int, 0x13>()); // Piccolo
+		case 0x11b: return f(std::integral_constant<unsigned int, 0x11b>()); // AES
+		default: throw std::invalid_argument("GFieldDispatch: no code compiled for this polynomial");
+	}
+}
+
+
 #endif
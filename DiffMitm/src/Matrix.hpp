@@ -3,20 +3,48 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 
 #include "GFElement.hpp"
+#include "GFRow.hpp"
 
 
-class Matrix
+template <unsigned int Poly>
+class MatrixT
 {
 public:
-  Matrix() = default;
-  Matrix(std::vector<std::vector<std::pair<GFElement, int>>> const &);
-  Matrix(Matrix const &) = default;
-  Matrix(Matrix &&) = default;
-
-  Matrix & operator=(Matrix const &) = default;
-  Matrix & operator=(Matrix &&) = default;
+  typedef GFElementT<Poly> GFElement;
+  typedef GFRow<Poly> Row; // layout of the rows, packed for small fields
+
+  MatrixT() = default;
+  MatrixT(std::vector<std::vector<std::pair<GFElement, int>>> const &);
+  MatrixT(MatrixT const & m) : nbcols (m.nbcols), nblines (m.nblines), front(m.front), columns(m.columns), maxvar(m.maxvar), position(m.position), nzcap(m.nzcap), space(m.space), supspace(m.supspace) {
+    lines.reserve(nblines);
+    for (unsigned l = 0; l < nblines; ++l) lines.emplace_back(&space[0] + (m.lines[l]- &m.space[0]));
+    supports.reserve(nblines);
+    for (unsigned l = 0; l < nblines; ++l) supports.emplace_back(&supspace[0] + (m.supports[l]- &m.supspace[0]));
+  };
+  MatrixT(MatrixT &&) = default;
+
+  MatrixT & operator=(MatrixT const & m) {
+      nbcols = m.nbcols;
+      nblines = m.nblines;
+      front = m.front;
+      columns = m.columns;
+      maxvar = m.maxvar;
+      position = m.position;
+      nzcap = m.nzcap;
+      space = m.space;
+      supspace = m.supspace;
+      lines = std::vector<typename Row::Word*> ();
+      lines.reserve(nblines);
+      for (unsigned l = 0; l < nblines; ++l) lines.emplace_back(&space[0] + (m.lines[l]- &m.space[0]));
+      supports = std::vector<uint16_t*> ();
+      supports.reserve(nblines);
+      for (unsigned l = 0; l < nblines; ++l) supports.emplace_back(&supspace[0] + (m.supports[l]- &m.supspace[0]));
+      return *this;
+  };
+  MatrixT & operator=(MatrixT &&) = default;
 
   unsigned checkZ(double * X);
   std::vector<int> checkK(double * X, double * SK, std::map<unsigned, unsigned> const & mapSK);
@@ -24,21 +52,52 @@ public:
   std::vector<int> checkK128_256(double * X);
   std::vector<int> checkK192(double * X);
 
-  bool dim2(int x1, int x2) const;
-
-  void echelonizeOn(std::vector<int> const &);
-
-  Matrix extract(std::vector<int> const &);
-
-  GFElement const & operator()(unsigned i, unsigned j) const { return lines[i][j];};
-  GFElement & operator()(unsigned i, unsigned j) {return lines[i][j];};
+  // dimension (0, 1 or 2) of the span of the coefficients of x1 and x2 on the lines start..
+  unsigned dim2(int x1, int x2, unsigned start = 0) const;
+  bool appears(int x, unsigned start) const {return dim2(x, x, start) != 0;};
+
+  // sets the variables of vars, in this order, as pivots of the lines start.. when they do not depend on the previous
+  // ones (setAsPivot on each of them), returns the line after the last pivot
+  unsigned echelonizeOn(std::vector<int> const & vars, unsigned start = 0);
+
+  // pivots the pairs (x, -x) of vars on the lines start.. until the x left are nonlinear (x and -x are independent):
+  // x is pivoted when -x depends on it and -x is pivoted when x does not appear, both are removed from vars.
+  // Returns the line after the last pivot.
+  unsigned echelonizeOnPairs(std::vector<int> & vars, unsigned start);
+
+  MatrixT extract(std::vector<int> const &);
+
+  GFElement operator()(unsigned i, unsigned j) const { return Row::get(lines[i], j);};
+  void setCoef(unsigned i, unsigned j, GFElement const & x) {
+    if ((Row::get(lines[i], j) == 0) != (x == 0)) supports[i][0] = nzstale;
+    Row::set(lines[i], j, x.getValue());
+  };
+
+  // columns of the nonzero coefficients of line i, in increasing order (use: for (unsigned c : nonzeros(i)) ...)
+  struct Support {
+    uint16_t const * first;
+    uint16_t const * last;
+    uint16_t const * begin() const {return first;};
+    uint16_t const * end() const {return last;};
+    unsigned size() const {return last - first;};
+  };
+  Support nonzeros(unsigned i) const {
+    auto const s = supports[i];
+    if (s[0] == nzstale) resetSupport(i);
+    return Support {s + 1, s + 1 + s[0]};
+  };
+
+  // true if line i has no nonzero coefficient on the columns set in mask (bit j%64 of mask[j/64])
+  bool isZeroOn(unsigned i, std::vector<uint64_t> const & mask) const;
 
   int getFront(unsigned i) const {return front[i];};
   int getColumns(unsigned i) const {return columns[i];};
 
-  void printLine(unsigned i);
+  // line of variable x if it is a front (nblines otherwise), column of x if it is a column (nbcols otherwise)
+  unsigned lineOf(int x) const {auto const p = positionOf(x); return p < nblines ? p : nblines;};
+  unsigned columnOf(int x) const {auto const p = positionOf(x); return p != nopos && p >= nblines ? p - nblines : nbcols;};
 
-  friend std::ostream& operator<<( std::ostream &flux, Matrix const& mat);
+  void printLine(unsigned i);
 
   bool setAsPivot(int x, unsigned start);
   bool isLinear(int x, unsigned start);
@@ -50,16 +109,40 @@ private:
   std::vector<int> front;
   std::vector<int> columns;
 
-  std::vector<GFElement> space;
-  std::vector<GFElement*> lines;
-
-  void swapLineColumn(unsigned l, unsigned c);
+  // position[x + maxvar] is l if front[l] == x, nblines + c if columns[c] == x and nopos if x is not in the system
+  static constexpr uint16_t nopos = 0xffff;
 
+  int maxvar;
+  std::vector<uint16_t> position;
 
+  unsigned positionOf(int x) const {return (x < -maxvar || x > maxvar) ? nopos : position[x + maxvar];};
 
+  // Rows are dense for the row operations and sparse for the scans: supports[l][0] is the number
+  // of nonzero coefficients of line l and supports[l][1..] their sorted columns. The row operations
+  // only mark the support nzstale, it is rebuilt by the next scan of the line.
+  static constexpr uint16_t nzstale = 0xffff;
 
+  unsigned nzcap;
+  std::vector<typename Row::Word> space;
+  std::vector<typename Row::Word*> lines;
+  std::vector<uint16_t> supspace;
+  std::vector<uint16_t*> supports;
 
+  void resetSupport(unsigned i) const;
 
+  void swapLineColumn(unsigned l, unsigned c);
+  void swapLines(unsigned l1, unsigned l2);
 };
 
+template <unsigned int Poly>
+std::ostream& operator<<( std::ostream &flux, MatrixT<Poly> const& mat);
+
+// MatrixT is compiled in Matrix.cpp for the fields of GFieldDispatch
+extern template class MatrixT<0x02>;
+extern template class MatrixT<0x13>;
+extern template class MatrixT<0x11b>;
+
+// Matrices over the AES field, the one of the AES systems of equations
+typedef MatrixT<0x11b> Matrix;
+
 #endif
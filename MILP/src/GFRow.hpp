@@ -0,0 +1,325 @@
+/*
+ * GFRow.h
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+
+#ifndef DEF_GFROW
+#define DEF_GFROW
+
+#include <cstdint>
+#include <cstring>
+#include "GField.hpp"
+
+// Tables of the packed GF(2^4) rows: entry c*32 + i is c*i and entry c*32 + 16 + i is (c*i) << 4
+template <unsigned int Poly>
+constexpr std::array<GFSymbol, 32*16> GFRowNibbleTables()
+{
+	constexpr auto mult = GFieldMultTable<Poly>();
+	std::array<GFSymbol, 32*16> table {};
+	for (unsigned int c = 0; c < 16; ++c)
+	{
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			table[32*c + i] = mult[(c << 4) | i];
+			table[32*c + 16 + i] = static_cast<GFSymbol>(mult[(c << 4) | i] << 4);
+		}
+	}
+	return table;
+}
+
+
+/**
+ *  @brief     Storage of a row of coefficients of GF(2^n) as an array of machine words
+ *  @details   The generic layout stores one coefficient per GFSymbol. The operations work on
+ *             whole rows of n coefficients; the masks given to isZeroOn() hold one bit per
+ *             column (bit j%64 of mask[j/64]).
+ */
+
+template <unsigned int Poly, unsigned int Dim = GFieldDim(Poly)>
+struct GFRow
+{
+	typedef GFSymbol Word;
+
+	static unsigned int nbWords(const unsigned int n) {return n;};
+
+	static GFSymbol get(Word const * row, const unsigned int j) {return row[j];};
+	static void set(Word * row, const unsigned int j, const GFSymbol val) {row[j] = val;};
+
+	static void axpy(Word * dst, Word const * src, const GFSymbol coef, const unsigned int n) {GField<Poly>::row_axpy(dst, src, coef, n);};
+	static void scale(Word * row, const GFSymbol coef, const unsigned int n) {GField<Poly>::row_scale(row, coef, n);};
+
+	static bool isZeroOn(Word const * row, uint64_t const * mask, const unsigned int n)
+	{
+		for (unsigned int j = 0; j < n; ++j)
+		{
+			if (row[j] != 0 && ((mask[j/64] >> (j%64)) & 1) != 0) return false;
+		}
+		return true;
+	}
+
+	// Writes the increasing columns of the nonzero coefficients in support and returns their number,
+	// or cap + 1 as soon as there are more than cap of them. When mask is given, the same columns are
+	// also set in it (one bit per column, the caller clears it).
+	static unsigned int support(Word const * row, const unsigned int n, uint16_t * support, const unsigned int cap, uint64_t * mask = nullptr)
+	{
+		unsigned int nb = 0;
+		unsigned int j = 0;
+#if defined(__AVX2__)
+		const __m256i zero = _mm256_setzero_si256();
+		for (; j + 32 <= n; j += 32)
+		{
+			const __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row + j));
+			uint32_t nz = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, zero)));
+			if (mask != nullptr) mask[j/64] |= uint64_t(nz) << (j%64);
+			while (nz != 0)
+			{
+				if (nb == cap) return cap + 1;
+				support[nb++] = j + __builtin_ctz(nz);
+				nz &= nz - 1;
+			}
+		}
+#endif
+#if defined(__SSSE3__)
+		for (; j + 16 <= n; j += 16)
+		{
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row + j));
+			uint32_t nz = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128()))) & 0xffff;
+			if (mask != nullptr) mask[j/64] |= uint64_t(nz) << (j%64);
+			while (nz != 0)
+			{
+				if (nb == cap) return cap + 1;
+				support[nb++] = j + __builtin_ctz(nz);
+				nz &= nz - 1;
+			}
+		}
+#endif
+		for (; j < n; ++j)
+		{
+			if (row[j] == 0) continue;
+			if (mask != nullptr) mask[j/64] |= uint64_t(1) << (j%64);
+			if (nb == cap) return cap + 1;
+			support[nb++] = j;
+		}
+		return nb;
+	}
+};
+
+/**
+ *  @brief     Rows over F_2 are packed 64 coefficients per word
+ *  @details   A row operation is a XOR of words and isZeroOn() is an AND followed by a test to zero.
+ */
+
+template <>
+struct GFRow<0x02, 1>
+{
+	typedef uint64_t Word;
+
+	static unsigned int nbWords(const unsigned int n) {return (n + 63)/64;};
+
+	static GFSymbol get(Word const * row, const unsigned int j) {return (row[j/64] >> (j%64)) & 1;};
+	static void set(Word * row, const unsigned int j, const GFSymbol val)
+	{
+		row[j/64] = (row[j/64] & ~(uint64_t(1) << (j%64))) | (uint64_t(val & 1) << (j%64));
+	};
+
+	static void axpy(Word * dst, Word const * src, const GFSymbol coef, const unsigned int n)
+	{
+		if (coef == 0) return;
+		const unsigned int nw = nbWords(n);
+		for (unsigned int w = 0; w < nw; ++w) dst[w] ^= src[w];
+	};
+
+	static void scale(Word * row, const GFSymbol coef, const unsigned int n)
+	{
+		if (coef == 0) std::memset(row, 0, nbWords(n)*sizeof(Word));
+	};
+
+	static bool isZeroOn(Word const * row, uint64_t const * mask, const unsigned int n)
+	{
+		const unsigned int nw = nbWords(n);
+		uint64_t acc = 0;
+		for (unsigned int w = 0; w < nw; ++w) acc |= row[w] & mask[w];
+		return acc == 0;
+	}
+
+	static unsigned int support(Word const * row, const unsigned int n, uint16_t * support, const unsigned int cap, uint64_t * mask = nullptr)
+	{
+		const unsigned int nw = nbWords(n);
+		unsigned int nb = 0;
+		for (unsigned int w = 0; w < nw; ++w)
+		{
+			if (mask != nullptr) mask[w] |= row[w];
+			for (uint64_t x = row[w]; x != 0; x &= x - 1)
+			{
+				if (nb == cap) return cap + 1;
+				support[nb++] = 64*w + __builtin_ctzll(x);
+			}
+		}
+		return nb;
+	}
+};
+
+
+/**
+ *  @brief     Rows over GF(2^4) are packed two coefficients per byte
+ *  @details   Coefficient j is the low nibble of byte j/2 if j is even, the high one otherwise.
+ *             Multiplying a packed byte by c is two lookups in the 16-entry tables of c
+ *             (one per nibble), which stay in registers for the whole row.
+ */
+
+template <unsigned int Poly>
+struct GFRow<Poly, 4>
+{
+	typedef GFSymbol Word;
+
+	static unsigned int nbWords(const unsigned int n) {return (n + 1)/2;};
+
+	static GFSymbol get(Word const * row, const unsigned int j) {return (row[j/2] >> (4*(j%2))) & 0x0f;};
+	static void set(Word * row, const unsigned int j, const GFSymbol val)
+	{
+		const unsigned int shift = 4*(j%2);
+		row[j/2] = static_cast<Word>((row[j/2] & ~(0x0f << shift)) | ((val & 0x0f) << shift));
+	};
+
+	static void axpy(Word * dst, Word const * src, const GFSymbol coef, const unsigned int n);
+	static void scale(Word * row, const GFSymbol coef, const unsigned int n);
+
+	static bool isZeroOn(Word const * row, uint64_t const * mask, const unsigned int n)
+	{
+		const unsigned int nw = nbWords(n);
+		for (unsigned int w = 0; w < nw; ++w)
+		{
+			if (row[w] == 0) continue;
+			const unsigned int j = 2*w;
+			if ((row[w] & 0x0f) != 0 && ((mask[j/64] >> (j%64)) & 1) != 0) return false;
+			if ((row[w] & 0xf0) != 0 && ((mask[(j+1)/64] >> ((j+1)%64)) & 1) != 0) return false;
+		}
+		return true;
+	}
+
+	static unsigned int support(Word const * row, const unsigned int n, uint16_t * support, const unsigned int cap, uint64_t * mask = nullptr)
+	{
+		const unsigned int nw = nbWords(n);
+		unsigned int nb = 0;
+		for (unsigned int w = 0; w < nw; ++w)
+		{
+			if (row[w] == 0) continue;
+			for (unsigned int j = 2*w; j < 2*w + 2; ++j)
+			{
+				if (((row[w] >> (4*(j%2))) & 0x0f) == 0) continue;
+				if (mask != nullptr) mask[j/64] |= uint64_t(1) << (j%64);
+				if (nb == cap) return cap + 1;
+				support[nb++] = j;
+			}
+		}
+		return nb;
+	}
+
+private:
+	alignas(16) static constexpr std::array<GFSymbol, 32*16> m_table = GFRowNibbleTables<Poly>();
+
+	static Word multiply(const GFSymbol coef, const Word x) {return m_table[32*coef + (x & 0x0f)] ^ m_table[32*coef + 16 + (x >> 4)];};
+#if defined(__AVX2__)
+	static __m256i multiply(const __m256i x, const __m256i lo, const __m256i hi)
+	{
+		const __m256i mask = _mm256_set1_epi8(0x0f);
+		const __m256i xlo = _mm256_and_si256(x, mask);
+		const __m256i xhi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+		return _mm256_xor_si256(_mm256_shuffle_epi8(lo, xlo), _mm256_shuffle_epi8(hi, xhi));
+	}
+#elif defined(__SSSE3__)
+	static __m128i multiply(const __m128i x, const __m128i lo, const __m128i hi)
+	{
+		const __m128i mask = _mm_set1_epi8(0x0f);
+		const __m128i xlo = _mm_and_si128(x, mask);
+		const __m128i xhi = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+		return _mm_xor_si128(_mm_shuffle_epi8(lo, xlo), _mm_shuffle_epi8(hi, xhi));
+	}
+#endif
+};
+
+
+template <unsigned int Poly>
+inline void GFRow<Poly, 4>::axpy(Word * dst, Word const * src, const GFSymbol coef, const unsigned int n)
+{
+	if (coef == 0) return;
+	const unsigned int nw = nbWords(n);
+	if (coef == 1) // both nibbles are added at once
+	{
+		GField<0x02>::row_axpy(dst, src, 1, nw);
+		return;
+	}
+	unsigned int i = 0;
+#if defined(__AVX2__)
+	const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef])));
+	const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef + 16])));
+	for (; i + 32 <= nw; i += 32)
+	{
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(d, multiply(s, lo, hi)));
+	}
+#elif defined(__SSSE3__)
+	const __m128i lo = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef]));
+	const __m128i hi = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef + 16]));
+	for (; i + 16 <= nw; i += 16)
+	{
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(d, multiply(s, lo, hi)));
+	}
+#endif
+	for (; i < nw; ++i) dst[i] ^= multiply(coef, src[i]);
+}
+
+template <unsigned int Poly>
+inline void GFRow<Poly, 4>::scale(Word * row, const GFSymbol coef, const unsigned int n)
+{
+	if (coef == 1) return;
+	const unsigned int nw = nbWords(n);
+	if (coef == 0)
+	{
+		if (nw != 0) std::memset(row, 0, nw);
+		return;
+	}
+	unsigned int i = 0;
+#if defined(__AVX2__)
+	const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef])));
+	const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef + 16])));
+	for (; i + 32 <= nw; i += 32)
+	{
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(row + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(row + i), multiply(x, lo, hi));
+	}
+#elif defined(__SSSE3__)
+	const __m128i lo = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef]));
+	const __m128i hi = _mm_load_si128(reinterpret_cast<__m128i const *>(&m_table[32*coef + 16]));
+	for (; i + 16 <= nw; i += 16)
+	{
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), multiply(x, lo, hi));
+	}
+#endif
+	for (; i < nw; ++i) row[i] = multiply(coef, row[i]);
+}
+
+
+#endif
@@ -23,7 +23,8 @@ void printVar(ostream &flux, int x) {
   }
 }
 
-Matrix::Matrix(vector<vector<pair<GFElement, int>>> const & sys) {
+template <unsigned int Poly>
+MatrixT<Poly>::MatrixT(vector<vector<pair<GFElement, int>>> const & sys) {
   set<int> variables;
   for (auto const & v : sys) {
     for (auto const & p : v) variables.emplace(p.second);
@@ -60,11 +61,11 @@ Matrix::Matrix(vector<vector<pair<GFElement, int>>> const & sys) {
         swap(v[p], v[c]);
       }
       auto const coefInv = mat[p][p].getInverse();
-      for (c = p; c < m; ++c) mat[p][c] *= coefInv;
+      GFElement::row_scale(&mat[p][p], coefInv, m-p);
       for (unsigned l = 0; l < n; ++l) {
         if (mat[l][p] == 0 || l == p) continue;
         auto const coef = mat[l][p];
-        for (c = p; c < m; ++c) mat[l][c] -= coef*mat[p][c];
+        GFElement::row_axpy(&mat[l][p], &mat[p][p], coef, m-p);
       }
     }
   }
@@ -83,79 +84,176 @@ Matrix::Matrix(vector<vector<pair<GFElement, int>>> const & sys) {
   for (unsigned i = 0; i < n; ++i) front[i] = v[i];
   columns = vector<int> (m-n);
   for (unsigned i = n; i < m; ++i) columns[i-n] = v[i];
-  space = vector<GFElement> (n*(m-n));
-  for (unsigned i = 0; i < n; ++i) {
-    for (unsigned j = n; j < m; ++j) space[i*(m-n) + j-n] = mat[i][j];
-  }
   nbcols = m-n;
   nblines = n;
-  lines = vector<GFElement *> (n);
-  for (unsigned i = 0; i < n; ++i) lines[i] = space.data() + i*nbcols;
+  maxvar = 0;
+  for (auto x : v) maxvar = max(maxvar, abs(x));
+  position = vector<uint16_t> (2*maxvar+1, nopos);
+  for (unsigned i = 0; i < m; ++i) position[v[i] + maxvar] = i;
+  auto const nbwords = Row::nbWords(nbcols);
+  nzcap = nbcols;
+  space = vector<typename Row::Word> (n*nbwords, 0);
+  lines = vector<typename Row::Word *> (n);
+  supspace = vector<uint16_t> (n*(nzcap+1));
+  supports = vector<uint16_t *> (n);
+  for (unsigned i = 0; i < n; ++i) {
+    lines[i] = space.data() + i*nbwords;
+    for (unsigned j = n; j < m; ++j) Row::set(lines[i], j-n, mat[i][j].getValue());
+    supports[i] = supspace.data() + i*(nzcap+1);
+    resetSupport(i);
+  }
 }
 
-void Matrix::swapLineColumn(unsigned l, unsigned c) {
+template <unsigned int Poly>
+void MatrixT<Poly>::resetSupport(unsigned i) const {
+  auto const s = supports[i];
+  s[0] = Row::support(lines[i], nbcols, s + 1, nzcap);
+}
+
+template <unsigned int Poly>
+bool MatrixT<Poly>::isZeroOn(unsigned i, vector<uint64_t> const & mask) const {
+  for (unsigned c : nonzeros(i)) {
+    if ((mask[c/64] >> (c%64)) & 1) return false;
+  }
+  return true;
+}
+
+template <unsigned int Poly>
+void MatrixT<Poly>::swapLineColumn(unsigned l, unsigned c) {
   auto coef = (*this)(l,c).getInverse();
-  for (unsigned i = 0; i < nbcols; ++i) (*this)(l,i) *= coef;
-  (*this)(l,c) = 0;
+  Row::scale(lines[l], coef.getValue(), nbcols);
+  setCoef(l, c, 0);
   for (unsigned i = 0; i < nblines; ++i) {
     if ((*this)(i,c) == 0) continue;
     auto coef2 = (*this)(i,c);
-    for (unsigned j = 0; j < nbcols; ++j) (*this)(i,j) += coef2*(*this)(l,j);
-    (*this)(i,c) = coef*coef2;
+    Row::axpy(lines[i], lines[l], coef2.getValue(), nbcols);
+    setCoef(i, c, coef*coef2);
+    supports[i][0] = nzstale;
   }
-  (*this)(l,c) = coef;
+  setCoef(l, c, coef);
   swap(front[l], columns[c]);
+  position[front[l] + maxvar] = l;
+  position[columns[c] + maxvar] = nblines + c;
 }
 
-unsigned Matrix::checkZ(double * X) {
+template <unsigned int Poly>
+unsigned MatrixT<Poly>::checkZ(double * X) {
   for (unsigned l = 0; l < nblines; ++l) {
     auto const u = abs(front[l]);
     if (X[u] < 0.5) {
-      unsigned c = 0;
-      while (c < nbcols && ((*this)(l,c) == 0 || X[abs(columns[c])] < 0.5)) ++c;
+      unsigned c = nbcols;
+      for (unsigned cc : nonzeros(l)) {
+        if (X[abs(columns[cc])] >= 0.5) {c = cc; break;}
+      }
       if (c < nbcols) swapLineColumn(l,c);
     }
   }
 
+  vector<uint64_t> active ((nbcols + 63)/64, 0);
+  for (unsigned c = 0; c < nbcols; ++c) {
+    if (X[abs(columns[c])] >= 0.5) active[c/64] |= uint64_t(1) << (c%64);
+  }
   for (unsigned l = 0; l < nblines; ++l) {
     if (X[abs(front[l])] < 0.5) continue;
-    unsigned c = 0;
-    while (c < nbcols && ((*this)(l,c) == 0 || X[abs(columns[c])] < 0.5)) ++c;
-    if (c == nbcols) return l;
+    if (isZeroOn(l, active)) return l;
   }
 
   return nblines;
 }
 
-bool Matrix::setAsPivot(int x, unsigned start) {
+template <unsigned int Poly>
+void MatrixT<Poly>::swapLines(unsigned l1, unsigned l2) {
+  swap(front[l1], front[l2]);
+  swap(lines[l1], lines[l2]);
+  swap(supports[l1], supports[l2]);
+  position[front[l1] + maxvar] = l1;
+  position[front[l2] + maxvar] = l2;
+}
+
+template <unsigned int Poly>
+bool MatrixT<Poly>::setAsPivot(int x, unsigned start) {
+  auto const lx = lineOf(x);
+  if (lx < nblines) {
+    if (lx < start) return false;
+    swapLines(lx, start);
+    return true;
+  }
+  auto const c = columnOf(x);
+  if (c == nbcols) return false;
   for (unsigned l = start; l < nblines; ++l) {
-    if (front[l] == x) {
-      swap(front[l], front[start]);
-      swap(lines[l], lines[start]);
+    if ((*this)(l,c) != 0) {
+      swapLineColumn(l,c);
+      swapLines(l, start);
       return true;
     }
   }
-  for (unsigned c = 0; c < nbcols; ++c) {
-    if (columns[c] == x) {
-      for (unsigned l = start; l < nblines; ++l) {
-        if ((*this)(l,c) != 0) {
-          swapLineColumn(l,c);
-          swap(front[l], front[start]);
-          swap(lines[l], lines[start]);
-          return true;
-        }
-      }
-      return false;
+  return false;
+}
+
+template <unsigned int Poly>
+bool MatrixT<Poly>::isLinear(int x, unsigned start) {
+  return dim2(x, -x, start) < 2;
+}
+
+template <unsigned int Poly>
+unsigned MatrixT<Poly>::dim2(int x1, int x2, unsigned start) const {
+  // the coefficients of a front are a unit vector, the ones of a column are read on the lines start..
+  auto const l1 = lineOf(x1), l2 = lineOf(x2);
+  auto const c1 = columnOf(x1), c2 = columnOf(x2);
+  auto const appearsOn = [this, start](unsigned l, unsigned c) {
+    if (l < nblines) return l >= start;
+    if (c == nbcols) return false;
+    for (unsigned i = start; i < nblines; ++i) {
+      if ((*this)(i,c) != 0) return true;
     }
+    return false;
+  };
+  bool const a1 = appearsOn(l1, c1), a2 = appearsOn(l2, c2);
+  if (!a1 || !a2) return a1 || a2;
+  if (l1 < nblines && l2 < nblines) return l1 == l2 ? 1 : 2;
+  if (l1 < nblines || l2 < nblines) { // x1 (or x2) is the front of l: dependent if the column is zero outside of l
+    auto const l = min(l1, l2);
+    auto const c = min(c1, c2);
+    for (unsigned i = start; i < nblines; ++i) {
+      if (i != l && (*this)(i,c) != 0) return 2;
+    }
+    return 1;
   }
-  return false;
+  if (c1 == c2) return 1;
+  unsigned i = start;
+  while ((*this)(i,c1) == 0) ++i;
+  auto const ratio = (*this)(i,c2)*(*this)(i,c1).getInverse();
+  for (i = start; i < nblines; ++i) {
+    if ((*this)(i,c2) != ratio*(*this)(i,c1)) return 2;
+  }
+  return 1;
 }
 
-bool Matrix::isLinear(int x, unsigned start) {
-  if (setAsPivot(x, start)) {
-    return !setAsPivot(-x, start+1);
+template <unsigned int Poly>
+unsigned MatrixT<Poly>::echelonizeOn(vector<int> const & vars, unsigned start) {
+  for (auto x : vars) {
+    if (setAsPivot(x, start)) ++start;
   }
-  else return true;
+  return start;
+}
+
+// The tests are done on the coefficients (dim2), without pivoting: only the removed variables are pivoted
+// and each removal starts again from the beginning since it can make linear the variables already tested
+template <unsigned int Poly>
+unsigned MatrixT<Poly>::echelonizeOnPairs(vector<int> & vars, unsigned start) {
+  unsigned i = 0, n = vars.size();
+  while (i < n) {
+    if (dim2(vars[i], -vars[i], start) == 2) { // does not linearly appear
+      ++i;
+      continue;
+    }
+    if (setAsPivot(vars[i], start)) ++start; // linearly appear
+    else if (setAsPivot(-vars[i], start)) ++start; // vars[i] does not appear in the system
+    vars[i] = vars[--n];
+    i = 0;
+  }
+  vars.resize(n);
+  return start;
 }
 
 bool isKeySboxAES128(int x) { // 16*(4r + 1) + 4*i + 3
@@ -172,14 +270,15 @@ bool isKeySboxAES192(int x) { // 16*(4r + 1) + 4*i + 3
   return ((c+r)%6 == 5);
 }
 
-vector<int> Matrix::checkK128_256(double * X) {
-  unsigned start = 0;
+template <unsigned int Poly>
+vector<int> MatrixT<Poly>::checkK128_256(double * X) {
+  vector<int> unknown;
   vector<int> toprocess1;
   vector<int> toprocess2;
   for (auto x : front) {
     if (X[abs(x)] > 0.5) {
       if (!isKeySboxAES128(x)) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
+        unknown.emplace_back(x);
       }
       else if (x > 0) toprocess2.emplace_back(x);
     }
@@ -187,32 +286,16 @@ vector<int> Matrix::checkK128_256(double * X) {
   for (auto x : columns) {
     if (X[abs(x)] > 0.5) {
       if (!isKeySboxAES128(x)) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
+        unknown.emplace_back(x);
       }
       else if (x > 0) toprocess2.emplace_back(x);
     }
   }
 
-  unsigned i = 0, n = toprocess2.size();
-  while (i < n) {
-    if (setAsPivot(toprocess2[i], start)) {
-      if (setAsPivot(-toprocess2[i], start+1)) { // does not linearly appear
-        ++i;
-      }
-      else { // linearly appear
-        ++start;
-        toprocess2[i] = toprocess2[--n];
-        i = 0;
-      }
-    }
-    else { // toprocess_v[i] does not appear in the system
-      if (setAsPivot(-toprocess2[i], start)) ++start;
-      toprocess2[i] = toprocess2[--n];
-      i = 0;
-    }
-  }
+  // same order as pivoting them during the scan: a pivot only exchanges fronts and columns already visited
+  auto start = echelonizeOn(unknown);
+  start = echelonizeOnPairs(toprocess2, start);
 
-  toprocess2.resize(n);
 
   // if (n == 0) {
   //   for (unsigned i = 0; i < this->nblines; ++i) {
@@ -239,14 +322,15 @@ vector<int> Matrix::checkK128_256(double * X) {
   return toprocess2;
 }
 
-vector<int> Matrix::checkK192(double * X) {
-  unsigned start = 0;
+template <unsigned int Poly>
+vector<int> MatrixT<Poly>::checkK192(double * X) {
+  vector<int> unknown;
   vector<int> toprocess1;
   vector<int> toprocess2;
   for (auto x : front) {
     if (X[abs(x)] > 0.5) {
       if (!isKeySboxAES192(x)) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
+        unknown.emplace_back(x);
       }
       else if (x > 0) toprocess2.emplace_back(x);
     }
@@ -254,32 +338,16 @@ vector<int> Matrix::checkK192(double * X) {
   for (auto x : columns) {
     if (X[abs(x)] > 0.5) {
       if (!isKeySboxAES192(x)) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
+        unknown.emplace_back(x);
       }
       else if (x > 0) toprocess2.emplace_back(x);
     }
   }
 
-  unsigned i = 0, n = toprocess2.size();
-  while (i < n) {
-    if (setAsPivot(toprocess2[i], start)) {
-      if (setAsPivot(-toprocess2[i], start+1)) { // does not linearly appear
-        ++i;
-      }
-      else { // linearly appear
-        ++start;
-        toprocess2[i] = toprocess2[--n];
-        i = 0;
-      }
-    }
-    else { // toprocess_v[i] does not appear in the system
-      if (setAsPivot(-toprocess2[i], start)) ++start;
-      toprocess2[i] = toprocess2[--n];
-      i = 0;
-    }
-  }
+  // same order as pivoting them during the scan: a pivot only exchanges fronts and columns already visited
+  auto start = echelonizeOn(unknown);
+  start = echelonizeOnPairs(toprocess2, start);
 
-  toprocess2.resize(n);
 
   // if (n == 0) {
   //   for (unsigned i = 0; i < this->nblines; ++i) {
@@ -307,7 +375,8 @@ vector<int> Matrix::checkK192(double * X) {
 }
 
 /*
-vector<int> Matrix::checkK128_256(double * X) {
+template <unsigned int Poly>
+vector<int> MatrixT<Poly>::checkK128_256(double * X) {
   unsigned start = 0;
   vector<int> toprocess1;
   vector<int> toprocess2;
@@ -352,15 +421,16 @@ vector<int> Matrix::checkK128_256(double * X) {
 }
 */
 
-vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> const & mapSK) {
-  unsigned start = 0;
+template <unsigned int Poly>
+vector<int> MatrixT<Poly>::checkK(double * X, double * SK, map<unsigned, unsigned> const & mapSK) {
+  vector<int> unknown;
   vector<int> toprocess1;
   vector<int> toprocess2;
   for (auto x : front) {
     if (x >= 0 && X[x] < 0.5) {
       auto it = mapSK.find(x);
       if (it == mapSK.end()) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
+        unknown.emplace_back(x);
       }
       else {
         if (SK[it->second] < 0.5) toprocess2.emplace_back(x);
@@ -373,7 +443,7 @@ vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> cons
     if (x >= 0 && X[x] < 0.5) {
       auto it = mapSK.find(x);
       if (it == mapSK.end()) { // unknown state variable
-        if (setAsPivot(x, start)) ++start;
+        unknown.emplace_back(x);
       }
       else {
         if (SK[it->second] < 0.5) toprocess2.emplace_back(x);
@@ -383,6 +453,9 @@ vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> cons
     else if (x < 0 && X[-x] > 0.5 && SK[mapSK.at(-x)] < 0.5) toprocess1.emplace_back(x);
   }
 
+  // same order as pivoting them during the scan: a pivot only exchanges fronts and columns already visited
+  auto start = echelonizeOn(unknown);
+
   // cout << " in ------------ " << endl;
   // for (unsigned i = start; i < nblines; ++i) {
   //   //flux << mat.front[i];
@@ -401,24 +474,7 @@ vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> cons
 
   //auto backstart = start;
 
-  unsigned i = 0, n = toprocess2.size();
-  while (i < n) {
-    if (setAsPivot(toprocess2[i], start)) {
-      if (setAsPivot(-toprocess2[i], start+1)) { // does not linearly appear
-        ++i;
-      }
-      else { // linearly appear
-        ++start;
-        toprocess2[i] = toprocess2[--n];
-        i = 0;
-      }
-    }
-    else { // toprocess_v[i] does not appear in the system
-      if (setAsPivot(-toprocess2[i], start)) ++start;
-      toprocess2[i] = toprocess2[--n];
-      i = 0;
-    }
-  }
+  start = echelonizeOnPairs(toprocess2, start);
   // for (unsigned i = backstart; i < start; ++i) {
   //   //flux << mat.front[i];
   //   printVar(cout, front[i]);
@@ -449,14 +505,14 @@ vector<int> Matrix::checkK(double * X, double * SK, map<unsigned, unsigned> cons
   // }
   // cout << " ------------ " << endl;
 
-  toprocess2.resize(n);
-  for (auto x : toprocess1) if (setAsPivot(x, start)) toprocess2.emplace_back(abs(x));
+  for (auto x : toprocess1) if (appears(x, start)) toprocess2.emplace_back(abs(x));
 
 
   return toprocess2;
 }
 
-void Matrix::printLine(unsigned i) {
+template <unsigned int Poly>
+void MatrixT<Poly>::printLine(unsigned i) {
   printVar(cout, front[i]);
   for (unsigned j = 0; j < nbcols; ++j) {
     if ((*this)(i,j) != 0) {
@@ -469,20 +525,31 @@ void Matrix::printLine(unsigned i) {
   cout << endl;
 }
 
-ostream& operator<<( ostream &flux, Matrix const& mat)
+template <unsigned int Poly>
+ostream& operator<<( ostream &flux, MatrixT<Poly> const& mat)
 {
 	for (unsigned i = 0; i < mat.nblines; ++i) {
     //flux << mat.front[i];
-    printVar(flux, mat.front[i]);
+    printVar(flux, mat.getFront(i));
     for (unsigned j = 0; j < mat.nbcols; ++j) {
       if (mat(i,j) != 0) {
         flux << " + ";
         if (mat(i,j) != 1) flux << mat(i,j) << ".";
         //flux << mat.columns[j];
-        printVar(flux, mat.columns[j]);
+        printVar(flux, mat.getColumns(j));
       }
     }
     flux << endl;
   }
 	return flux;
 }
+
+
+// Fields available at runtime (see GFieldDispatch)
+template class MatrixT<0x02>;
+template class MatrixT<0x13>;
+template class MatrixT<0x11b>;
+
+template ostream& operator<<( ostream &flux, MatrixT<0x02> const& mat);
+template ostream& operator<<( ostream &flux, MatrixT<0x13> const& mat);
+template ostream& operator<<( ostream &flux, MatrixT<0x11b> const& mat);